@@ -0,0 +1,223 @@
+/*  Headless benchmarks of the density based clustering on
+ *  synthetic point clouds. Results are written to
+ *  clustering_bench.json unless --benchmark_out is given.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <opencv2/core.hpp>
+
+#include "clustering.h"
+#include "hdbscan.h"
+#include "mortonorder.h"
+#include "rasterclustering.h"
+
+
+namespace {
+
+double distance_point(cv::Point2d const& a, cv::Point2d const& b)
+{
+    return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y));
+}
+
+/**
+ * @brief syntheticPoints Generates num_points integer pixel positions.
+ *          Three quarters are drawn around gaussian blobs, the rest is
+ *          uniform noise. The area grows with the number of points so
+ *          the density matches the sample in src/main.cpp (300 points
+ *          on 400x400). Clouds are cached between benchmarks.
+ */
+const std::vector<cv::Point2d>& syntheticPoints(int num_points)
+{
+    static std::map<int, std::vector<cv::Point2d> > clouds;
+
+    std::vector<cv::Point2d>& data = clouds[num_points];
+    if (!data.empty())
+        return data;
+
+    const int side = static_cast<int>(400 * std::sqrt(num_points / 300.0));
+    const int num_blobs = std::max(1, num_points / 500);
+
+    cv::RNG rng(1234);
+    std::vector<cv::Point2d> centers;
+    for (int i = 0; i < num_blobs; ++i)
+        centers.push_back(cv::Point2d(rng.uniform(0, side), rng.uniform(0, side)));
+
+    data.reserve(num_points);
+    for (int i = 0; i < num_points; ++i) {
+        if (i % 4 == 3) {
+            data.push_back(cv::Point2d(rng.uniform(0, side), rng.uniform(0, side)));
+        } else {
+            const cv::Point2d& c = centers[i % num_blobs];
+            data.push_back(cv::Point2d(std::floor(c.x + rng.gaussian(15.0)),
+                                       std::floor(c.y + rng.gaussian(15.0))));
+        }
+    }
+    return data;
+}
+
+}
+
+
+/**
+ * Args: number of points, eps, min_pts.
+ * Cluster builds the full neighbour graph in O(n^2), sizes stop at 16k.
+ */
+static void BM_Cluster(benchmark::State& state)
+{
+    std::vector<cv::Point2d> data = syntheticPoints(static_cast<int>(state.range(0)));
+    const double eps = static_cast<double>(state.range(1));
+    const size_t min_pts = static_cast<size_t>(state.range(2));
+
+    size_t num_clusters = 0;
+    for (auto _ : state) {
+        std::vector<cv::Point2d> negatives;
+        std::vector<clustering::cluster<cv::Point2d> > clusters =
+            clustering::Cluster(&data[0], negatives, data.size(), eps, min_pts, &distance_point);
+        num_clusters = clusters.size();
+        benchmark::DoNotOptimize(clusters.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+    state.counters["clusters"] = static_cast<double>(num_clusters);
+}
+BENCHMARK(BM_Cluster)
+    ->ArgsProduct({{1000, 4000, 16000}, {5, 10, 20}, {2, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+
+/**
+ * Args: number of points, eps, min_pts. Same clouds as BM_Cluster, the
+ * blobs repeat pixel positions which ClusterDuplicates collapses.
+ */
+static void BM_ClusterDuplicates(benchmark::State& state)
+{
+    std::vector<cv::Point2d> data = syntheticPoints(static_cast<int>(state.range(0)));
+    const double eps = static_cast<double>(state.range(1));
+    const size_t min_pts = static_cast<size_t>(state.range(2));
+
+    size_t num_clusters = 0;
+    for (auto _ : state) {
+        std::vector<cv::Point2d> negatives;
+        std::vector<clustering::cluster<cv::Point2d> > clusters =
+            clustering::ClusterDuplicates(&data[0], negatives, data.size(), eps, min_pts, &distance_point);
+        num_clusters = clusters.size();
+        benchmark::DoNotOptimize(clusters.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+    state.counters["clusters"] = static_cast<double>(num_clusters);
+}
+BENCHMARK(BM_ClusterDuplicates)
+    ->ArgsProduct({{1000, 4000, 16000, 64000}, {5, 10, 20}, {2, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+
+/**
+ * Args: number of points, eps, min_pts. The points are drawn into a mask
+ * and clustered on the grid, so sizes go up to 1M points.
+ */
+static void BM_ClusterMask(benchmark::State& state)
+{
+    const std::vector<cv::Point2d>& data = syntheticPoints(static_cast<int>(state.range(0)));
+    const double eps = static_cast<double>(state.range(1));
+    const size_t min_pts = static_cast<size_t>(state.range(2));
+
+    //Blob points may fall outside of the image side, those are dropped
+    const int side = static_cast<int>(400 * std::sqrt(data.size() / 300.0));
+    cv::Mat mask = cv::Mat::zeros(side, side, CV_8UC1);
+    for (cv::Point2d const& p : data) {
+        if (p.x >= 0 && p.y >= 0 && p.x < side && p.y < side)
+            mask.at<uchar>(static_cast<int>(p.y), static_cast<int>(p.x)) = 255;
+    }
+
+    int num_clusters = 0;
+    cv::Mat labels;
+    for (auto _ : state) {
+        num_clusters = clustering::ClusterMask(mask, labels, eps, min_pts);
+        benchmark::DoNotOptimize(labels.data);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(mask.total()));
+    state.counters["clusters"] = static_cast<double>(num_clusters);
+}
+BENCHMARK(BM_ClusterMask)
+    ->ArgsProduct({{16000, 250000, 1000000}, {5, 10, 20}, {2, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+
+/**
+ * Args: number of points, min_pts, threads. min_cluster_size is fixed.
+ */
+static void BM_HDBSCAN(benchmark::State& state)
+{
+    std::vector<cv::Point2d> data = syntheticPoints(static_cast<int>(state.range(0)));
+    const size_t min_pts = static_cast<size_t>(state.range(1));
+    const unsigned num_threads = static_cast<unsigned>(state.range(2));
+
+    size_t num_clusters = 0;
+    for (auto _ : state) {
+        std::vector<cv::Point2d> negatives;
+        std::vector<clustering::cluster<cv::Point2d> > clusters =
+            clustering::HDBSCAN(&data[0], negatives, data.size(), min_pts, 50, nullptr, num_threads);
+        num_clusters = clusters.size();
+        benchmark::DoNotOptimize(clusters.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+    state.counters["clusters"] = static_cast<double>(num_clusters);
+}
+BENCHMARK(BM_HDBSCAN)
+    ->ArgsProduct({{16000, 250000, 1000000}, {4, 16}, {1, 4, 16}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+
+/**
+ * Args: number of points, eps, min_pts. Includes the Morton sort.
+ */
+static void BM_ClusterMorton(benchmark::State& state)
+{
+    std::vector<cv::Point2d> data = syntheticPoints(static_cast<int>(state.range(0)));
+    const double eps = static_cast<double>(state.range(1));
+    const size_t min_pts = static_cast<size_t>(state.range(2));
+
+    size_t num_clusters = 0;
+    for (auto _ : state) {
+        std::vector<cv::Point2d> negatives;
+        std::vector<clustering::cluster<cv::Point2d> > clusters =
+            clustering::ClusterMorton(&data[0], negatives, data.size(), eps, min_pts);
+        num_clusters = clusters.size();
+        benchmark::DoNotOptimize(clusters.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+    state.counters["clusters"] = static_cast<double>(num_clusters);
+}
+BENCHMARK(BM_ClusterMorton)
+    ->ArgsProduct({{16000, 250000, 1000000}, {5, 10, 20}, {2, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+
+int main(int argc, char** argv)
+{
+    //Default to a JSON report so runs can be compared across releases
+    std::vector<char*> args(argv, argv + argc);
+    std::string out_flag = "--benchmark_out=clustering_bench.json";
+    std::string format_flag = "--benchmark_out_format=json";
+    bool has_out = false;
+    for (int i = 1; i < argc; ++i)
+        has_out = has_out || std::string(argv[i]).compare(0, 16, "--benchmark_out=") == 0;
+    if (!has_out) {
+        args.push_back(&out_flag[0]);
+        args.push_back(&format_flag[0]);
+    }
+
+    int num_args = static_cast<int>(args.size());
+    benchmark::Initialize(&num_args, args.data());
+    if (benchmark::ReportUnrecognizedArguments(num_args, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -15,6 +15,8 @@
 #include <vector>
 #include <map>
 #include <list>
+#include <stdexcept>
+#include <utility>
 
 
 
@@ -130,6 +132,131 @@ void expandCluster(node<T>& point, adj_list<T>& neighbourhood, cluster<T>& c, gr
     }
 }
 
+/**
+ * @brief ClusterWeighted   Clusters points standing for weights[i] identical data
+ *                          points each. A point is core if the summed weights in
+ *                          its neighborhood, its own further copies included, reach
+ *                          min_pts, so the result is the one of Cluster on the
+ *                          expanded data. The clusters and negatives list every
+ *                          point weights[i] times.
+ * @param weights           At least 1 for every point, a weight of 0 throws
+ *                          std::invalid_argument.
+ * @param labels            If given, receives the cluster index of every point,
+ *                          -1 for outliers.
+ */
+template <typename T, typename DIST_T>
+std::vector<cluster<T>> ClusterWeighted(T* const&  dataset,
+                                        size_t const* weights,
+                                        cluster<T>& negatives,
+                                        size_t const dataset_size,
+                                        DIST_T const eps,
+                                        size_t const min_pts,
+                                        DIST_T(*distance_function)(T const& lhs, T const& rhs),
+                                        std::vector<long>* labels = nullptr)
+{
+    for (size_t i = 0; i < dataset_size; ++i) {
+        if (weights[i] == 0)
+            throw std::invalid_argument("ClusterWeighted: weights must be at least 1!");
+    }
+
+    std::vector<std::vector<size_t>> neighbours(dataset_size);
+    std::vector<size_t> counts(dataset_size);
+    for (size_t i = 0; i < dataset_size; ++i) {
+        if (distance_function(dataset[i], dataset[i]) < eps)
+            counts[i] += weights[i] - 1;
+        for (size_t j = 0; j < i; ++j) {
+            if (distance_function(dataset[i], dataset[j]) < eps) {
+                neighbours[i].push_back(j);
+                neighbours[j].push_back(i);
+                counts[i] += weights[j];
+                counts[j] += weights[i];
+            }
+        }
+    }
+
+    std::vector<long> label(dataset_size, -1);
+    std::vector<cluster<T>> clusters;
+    std::vector<size_t> pending;
+    for (size_t seed = 0; seed < dataset_size; ++seed) {
+        if (label[seed] >= 0 || counts[seed] < min_pts) continue;
+
+        const long id = static_cast<long>(clusters.size());
+        cluster<T> c;
+        label[seed] = id;
+        pending.push_back(seed);
+        while (!pending.empty()) {
+            const size_t i = pending.back();
+            pending.pop_back();
+            c.insert(c.end(), weights[i], dataset[i]);
+            if (counts[i] < min_pts) continue;
+            for (size_t j : neighbours[i]) {
+                if (label[j] < 0) {
+                    label[j] = id;
+                    pending.push_back(j);
+                }
+            }
+        }
+        clusters.push_back(c);
+    }
+
+    for (size_t i = 0; i < dataset_size; ++i) {
+        if (label[i] < 0)
+            negatives.insert(negatives.end(), weights[i], dataset[i]);
+    }
+    if (labels)
+        *labels = label;
+
+    return clusters;
+}
+
+/**
+ * @brief ClusterDuplicates Clusters like Cluster, but collapses data points with
+ *                          identical x and y into one weighted point first (see
+ *                          ClusterWeighted). Pays off for integer pixel positions,
+ *                          which repeat a lot. T needs x and y members, like
+ *                          cv::Point2d.
+ * @param labels            If given, receives the cluster index of every data
+ *                          point, -1 for outliers.
+ */
+template <typename T, typename DIST_T>
+std::vector<cluster<T>> ClusterDuplicates(T* const&  dataset,
+                                          cluster<T>& negatives,
+                                          size_t const dataset_size,
+                                          DIST_T const eps,
+                                          size_t const min_pts,
+                                          DIST_T(*distance_function)(T const& lhs, T const& rhs),
+                                          std::vector<long>* labels = nullptr)
+{
+    std::map<std::pair<double, double>, size_t> index;
+    std::vector<size_t> unique_of(dataset_size);
+    std::vector<T> unique;
+    std::vector<size_t> weights;
+    for (size_t i = 0; i < dataset_size; ++i) {
+        const std::pair<double, double> key(dataset[i].x, dataset[i].y);
+        auto found = index.find(key);
+        if (found == index.end()) {
+            found = index.insert(std::make_pair(key, unique.size())).first;
+            unique.push_back(dataset[i]);
+            weights.push_back(0);
+        }
+        ++weights[found->second];
+        unique_of[i] = found->second;
+    }
+
+    std::vector<long> unique_labels;
+    T* const unique_data = unique.data();
+    std::vector<cluster<T>> clusters = ClusterWeighted(unique_data, weights.data(), negatives, unique.size(),
+                                                       eps, min_pts, distance_function, &unique_labels);
+
+    if (labels) {
+        labels->resize(dataset_size);
+        for (size_t i = 0; i < dataset_size; ++i)
+            (*labels)[i] = unique_labels[unique_of[i]];
+    }
+
+    return clusters;
+}
+
 }// end of namespace
 
 
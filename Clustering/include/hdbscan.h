@@ -0,0 +1,496 @@
+/*  Hierarchical density based clustering (HDBSCAN) of 2D
+ *  points. Unlike Cluster it needs no eps: clusters of any
+ *  density are taken from the most stable branches of the
+ *  cluster hierarchy.
+ */
+
+#pragma once
+
+#ifndef CLUSTERING_HDBSCAN
+#define CLUSTERING_HDBSCAN
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "clustering.h"
+
+
+
+namespace clustering {
+
+namespace detail {
+
+/**
+ * Node of the kd tree, points [begin, end) of the tree order
+ */
+struct kd_node {
+    double min_x, min_y, max_x, max_y;
+    uint32_t begin, end;
+    int32_t left, right;
+    double min_core;
+    int64_t component;
+};
+
+/**
+ * @brief The kd_tree class 2D tree over a copy of the points in tree order,
+ *          leaves of up to 16 points.
+ */
+class kd_tree {
+public:
+    template <typename T>
+    kd_tree(T const* dataset, size_t size) : order(size), xs(size), ys(size) {
+        for (size_t i = 0; i < size; ++i)
+            order[i] = static_cast<uint32_t>(i);
+        if (size == 0)
+            return;
+
+        std::vector<std::pair<double, double>> p(size);
+        for (size_t i = 0; i < size; ++i)
+            p[i] = std::make_pair(static_cast<double>(dataset[i].x), static_cast<double>(dataset[i].y));
+
+        std::vector<int32_t> stack(1, build(p, 0, static_cast<uint32_t>(size)));
+        while (!stack.empty()) {
+            const int32_t n = stack.back();
+            stack.pop_back();
+            if (nodes[n].end - nodes[n].begin <= 16)
+                continue;
+
+            //Split the longer side at the median
+            const uint32_t begin = nodes[n].begin, end = nodes[n].end, mid = begin + (end - begin) / 2;
+            const bool split_x = nodes[n].max_x - nodes[n].min_x >= nodes[n].max_y - nodes[n].min_y;
+            std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                             [&](uint32_t a, uint32_t b) {
+                return split_x ? p[a].first < p[b].first : p[a].second < p[b].second;
+            });
+            const int32_t left = build(p, begin, mid);
+            const int32_t right = build(p, mid, end);
+            nodes[n].left = left;
+            nodes[n].right = right;
+            stack.push_back(left);
+            stack.push_back(right);
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            xs[i] = p[order[i]].first;
+            ys[i] = p[order[i]].second;
+        }
+    }
+
+    static double boxDistance2(kd_node const& n, double x, double y) {
+        const double dx = std::max(0.0, std::max(n.min_x - x, x - n.max_x));
+        const double dy = std::max(0.0, std::max(n.min_y - y, y - n.max_y));
+        return dx * dx + dy * dy;
+    }
+
+    /**
+     * @brief kthNeighbourDistance Distance from tree point i to its k-th
+     *          nearest other point, infinity if there are fewer.
+     */
+    double kthNeighbourDistance(uint32_t i, size_t k) const {
+        if (k == 0)
+            return 0.0;
+
+        std::vector<double> heap;
+        heap.reserve(k + 1);
+        std::vector<int32_t> stack(1, 0);
+        while (!stack.empty()) {
+            kd_node const& n = nodes[stack.back()];
+            stack.pop_back();
+            if (heap.size() == k && boxDistance2(n, xs[i], ys[i]) >= heap.front())
+                continue;
+            if (n.left < 0) {
+                for (uint32_t j = n.begin; j < n.end; ++j) {
+                    if (j == i)
+                        continue;
+                    const double dx = xs[i] - xs[j], dy = ys[i] - ys[j];
+                    const double d2 = dx * dx + dy * dy;
+                    if (heap.size() < k) {
+                        heap.push_back(d2);
+                        std::push_heap(heap.begin(), heap.end());
+                    } else if (d2 < heap.front()) {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.back() = d2;
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                }
+                continue;
+            }
+            //Nearer child last, so it is searched first
+            const bool left_near = boxDistance2(nodes[n.left], xs[i], ys[i]) <= boxDistance2(nodes[n.right], xs[i], ys[i]);
+            stack.push_back(left_near ? n.right : n.left);
+            stack.push_back(left_near ? n.left : n.right);
+        }
+        return heap.size() == k ? std::sqrt(heap.front()) : std::numeric_limits<double>::infinity();
+    }
+
+    std::vector<kd_node> nodes;
+
+    /**
+     * order[i] is the dataset index of tree point i
+     */
+    std::vector<uint32_t> order;
+    std::vector<double> xs;
+    std::vector<double> ys;
+
+private:
+    int32_t build(std::vector<std::pair<double, double>> const& p, uint32_t begin, uint32_t end) {
+        kd_node n;
+        n.min_x = n.min_y = std::numeric_limits<double>::infinity();
+        n.max_x = n.max_y = -std::numeric_limits<double>::infinity();
+        for (uint32_t i = begin; i < end; ++i) {
+            std::pair<double, double> const& q = p[order[i]];
+            n.min_x = std::min(n.min_x, q.first);
+            n.max_x = std::max(n.max_x, q.first);
+            n.min_y = std::min(n.min_y, q.second);
+            n.max_y = std::max(n.max_y, q.second);
+        }
+        n.begin = begin;
+        n.end = end;
+        n.left = n.right = -1;
+        n.min_core = 0.0;
+        n.component = -1;
+        nodes.push_back(n);
+        return static_cast<int32_t>(nodes.size()) - 1;
+    }
+};
+
+/**
+ * Edge of the minimum spanning tree between tree points
+ */
+struct mst_edge {
+    double weight;
+    uint32_t a, b;
+
+    bool operator<(mst_edge const& other) const {
+        if (weight != other.weight)
+            return weight < other.weight;
+        if (std::min(a, b) != std::min(other.a, other.b))
+            return std::min(a, b) < std::min(other.a, other.b);
+        return std::max(a, b) < std::max(other.a, other.b);
+    }
+};
+
+template <typename F>
+void parallelFor(size_t count, unsigned num_threads, F const& body)
+{
+    std::atomic<size_t> next(0);
+    auto run = [&] {
+        for (size_t begin = next.fetch_add(256); begin < count; begin = next.fetch_add(256)) {
+            const size_t end = std::min(begin + 256, count);
+            for (size_t i = begin; i < end; ++i)
+                body(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < num_threads; ++t)
+        threads.emplace_back(run);
+    run();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+inline size_t findSet(std::vector<size_t>& parent, size_t i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * @brief boruvkaMST Minimum spanning tree of the tree points under the mutual
+ *          reachability distance max(core[a], core[b], |a - b|). Every round
+ *          each component takes its cheapest outgoing edge, found by kd tree
+ *          searches pruned by distance, by core distance and by subtrees that
+ *          lie within the component.
+ */
+inline std::vector<mst_edge> boruvkaMST(kd_tree& tree, std::vector<double> const& core, unsigned num_threads)
+{
+    const size_t size = tree.xs.size();
+    std::vector<kd_node>& nodes = tree.nodes;
+
+    //Children come after their parents, so a reverse pass is bottom up
+    for (size_t k = nodes.size(); k-- > 0;) {
+        kd_node& n = nodes[k];
+        if (n.left < 0) {
+            n.min_core = std::numeric_limits<double>::infinity();
+            for (uint32_t j = n.begin; j < n.end; ++j)
+                n.min_core = std::min(n.min_core, core[j]);
+        } else {
+            n.min_core = std::min(nodes[n.left].min_core, nodes[n.right].min_core);
+        }
+    }
+
+    std::vector<size_t> sets(size);
+    for (size_t i = 0; i < size; ++i)
+        sets[i] = i;
+    std::vector<int64_t> component(size);
+    std::vector<mst_edge> best(size);
+    std::vector<mst_edge> component_best(size);
+    std::vector<mst_edge> mst;
+    mst.reserve(size ? size - 1 : 0);
+
+    while (mst.size() + 1 < size) {
+        for (size_t i = 0; i < size; ++i)
+            component[i] = static_cast<int64_t>(findSet(sets, i));
+        for (size_t k = nodes.size(); k-- > 0;) {
+            kd_node& n = nodes[k];
+            if (n.left < 0) {
+                n.component = component[n.begin];
+                for (uint32_t j = n.begin + 1; j < n.end && n.component >= 0; ++j)
+                    if (component[j] != n.component)
+                        n.component = -1;
+            } else {
+                n.component = nodes[n.left].component == nodes[n.right].component ? nodes[n.left].component : -1;
+            }
+        }
+
+        parallelFor(size, num_threads, [&](size_t i) {
+            mst_edge b = { std::numeric_limits<double>::infinity(), static_cast<uint32_t>(i), static_cast<uint32_t>(i) };
+            const double x = tree.xs[i], y = tree.ys[i];
+            std::vector<int32_t> stack(1, 0);
+            while (!stack.empty()) {
+                kd_node const& n = nodes[stack.back()];
+                stack.pop_back();
+                if (n.component == component[i])
+                    continue;
+                const double bound = std::max(std::max(core[i], n.min_core), std::sqrt(kd_tree::boxDistance2(n, x, y)));
+                if (bound > b.weight)
+                    continue;
+                if (n.left < 0) {
+                    for (uint32_t j = n.begin; j < n.end; ++j) {
+                        if (component[j] == component[i])
+                            continue;
+                        const double dx = x - tree.xs[j], dy = y - tree.ys[j];
+                        const mst_edge e = { std::max(std::max(core[i], core[j]), std::sqrt(dx * dx + dy * dy)),
+                                             static_cast<uint32_t>(i), j };
+                        if (e < b)
+                            b = e;
+                    }
+                    continue;
+                }
+                const bool left_near = kd_tree::boxDistance2(nodes[n.left], x, y) <= kd_tree::boxDistance2(nodes[n.right], x, y);
+                stack.push_back(left_near ? n.right : n.left);
+                stack.push_back(left_near ? n.left : n.right);
+            }
+            best[i] = b;
+        });
+
+        for (size_t i = 0; i < size; ++i)
+            component_best[i].weight = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < size; ++i) {
+            mst_edge& c = component_best[component[i]];
+            if (best[i].a != best[i].b && (c.weight == std::numeric_limits<double>::infinity() || best[i] < c))
+                c = best[i];
+        }
+
+        const size_t before = mst.size();
+        for (size_t i = 0; i < size; ++i) {
+            mst_edge const& e = component_best[i];
+            if (component[i] != static_cast<int64_t>(i) || e.weight == std::numeric_limits<double>::infinity())
+                continue;
+            const size_t a = findSet(sets, e.a), b = findSet(sets, e.b);
+            if (a != b) {
+                sets[std::max(a, b)] = std::min(a, b);
+                mst.push_back(e);
+            }
+        }
+        if (mst.size() == before)
+            break;
+    }
+    return mst;
+}
+
+}
+
+
+/**
+ * @brief HDBSCAN           Clusters 2D points without an eps. The core distance of a
+ *                          point is the distance to its min_pts-th nearest neighbour;
+ *                          points are joined in order of their mutual reachability
+ *                          max(core a, core b, distance), which gives the hierarchy
+ *                          of all DBSCAN clusterings over eps. The hierarchy is
+ *                          condensed to clusters of at least min_cluster_size points
+ *                          and the clusters that persist longest (excess of mass) are
+ *                          returned. Core distances and the spanning tree use a kd
+ *                          tree; the Boruvka rounds run on num_threads threads, 0 for
+ *                          one per core. T needs x and y members, like cv::Point2d.
+ * @param dataset           Data points
+ * @param negatives         The outliers are referenced here.
+ * @param dataset_size      Size of the dataset
+ * @param min_pts           Neighbours defining the core distance, as in Cluster
+ * @param min_cluster_size  The smallest cluster, at least 2
+ * @param labels            If given, receives the cluster index of every point,
+ *                          -1 for outliers.
+ * @return                  The function returns the vector of clusters.
+ */
+template <typename T>
+std::vector<cluster<T>> HDBSCAN(T* const& dataset,
+                                cluster<T>& negatives,
+                                size_t const dataset_size,
+                                size_t const min_pts,
+                                size_t const min_cluster_size,
+                                std::vector<long>* labels = nullptr,
+                                unsigned num_threads = 0)
+{
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t n = dataset_size;
+    const size_t mcs = std::max<size_t>(min_cluster_size, 2);
+
+    std::vector<long> label(n, -1);
+    std::vector<cluster<T>> clusters;
+
+    if (n >= mcs) {
+        detail::kd_tree tree(dataset, n);
+
+        std::vector<double> core(n);
+        detail::parallelFor(n, num_threads, [&](size_t i) {
+            core[i] = tree.kthNeighbourDistance(static_cast<uint32_t>(i), std::min(min_pts, n - 1));
+        });
+
+        std::vector<detail::mst_edge> mst = detail::boruvkaMST(tree, core, num_threads);
+        std::sort(mst.begin(), mst.end());
+
+        //Density levels lambda = 1 / distance, duplicates get a finite top level
+        double min_weight = std::numeric_limits<double>::infinity();
+        for (detail::mst_edge const& e : mst)
+            if (e.weight > 0)
+                min_weight = std::min(min_weight, e.weight);
+        const double max_lambda = min_weight < std::numeric_limits<double>::infinity() ? 2.0 / min_weight : 1.0;
+        auto lambdaOf = [&](double d) { return d > 0 ? 1.0 / d : max_lambda; };
+
+        //Single linkage dendrogram, nodes n.. merge two sets at dist
+        const size_t num_nodes = n + mst.size();
+        std::vector<size_t> left(num_nodes), right(num_nodes), node_size(num_nodes, 1);
+        std::vector<double> dist(num_nodes, 0.0);
+        std::vector<size_t> sets(n), set_node(n);
+        for (size_t i = 0; i < n; ++i)
+            sets[i] = set_node[i] = i;
+        for (size_t k = 0; k < mst.size(); ++k) {
+            const size_t a = detail::findSet(sets, mst[k].a), b = detail::findSet(sets, mst[k].b);
+            const size_t node = n + k;
+            left[node] = set_node[a];
+            right[node] = set_node[b];
+            node_size[node] = node_size[left[node]] + node_size[right[node]];
+            dist[node] = mst[k].weight;
+            sets[std::max(a, b)] = std::min(a, b);
+            set_node[std::min(a, b)] = node;
+        }
+
+        //Condense top down: a split into two parts of mcs points makes two new
+        //clusters, smaller parts fall out of the cluster as points
+        std::vector<long> relabel(num_nodes, -1);
+        std::vector<size_t> cluster_parent(1, 0);
+        std::vector<double> birth(1, 0.0), stability(1, 0.0);
+        std::vector<size_t> falls_from(n, 0);
+        std::vector<size_t> stack;
+
+        auto dropPoints = [&](size_t from, size_t cluster, double lambda) {
+            stack.push_back(from);
+            while (!stack.empty()) {
+                const size_t s = stack.back();
+                stack.pop_back();
+                if (s < n) {
+                    falls_from[tree.order[s]] = cluster;
+                    stability[cluster] += lambda - birth[cluster];
+                } else {
+                    relabel[s] = -2;
+                    stack.push_back(left[s]);
+                    stack.push_back(right[s]);
+                }
+            }
+        };
+
+        //Without a connected tree, e.g. infinite core distances, the
+        //remaining sets all fall out of the root
+        if (mst.size() + 1 < n) {
+            for (size_t i = 0; i < n; ++i)
+                if (detail::findSet(sets, i) == i && node_size[set_node[i]] < n)
+                    dropPoints(set_node[i], 0, 0.0);
+        } else {
+            relabel[num_nodes - 1] = 0;
+        }
+
+        for (size_t node = num_nodes; node-- > n;) {
+            if (relabel[node] < 0)
+                continue;
+            const size_t c = static_cast<size_t>(relabel[node]);
+            const double lambda = lambdaOf(dist[node]);
+            const size_t l = left[node], r = right[node];
+            const bool big_l = node_size[l] >= mcs, big_r = node_size[r] >= mcs;
+
+            if (big_l && big_r) {
+                for (size_t child : { l, r }) {
+                    relabel[child] = static_cast<long>(birth.size());
+                    cluster_parent.push_back(c);
+                    birth.push_back(lambda);
+                    stability.push_back(0.0);
+                    stability[c] += (lambda - birth[c]) * node_size[child];
+                }
+            } else {
+                if (big_l)
+                    relabel[l] = static_cast<long>(c);
+                else
+                    dropPoints(l, c, lambda);
+                if (big_r)
+                    relabel[r] = static_cast<long>(c);
+                else
+                    dropPoints(r, c, lambda);
+            }
+        }
+
+        //Excess of mass: a cluster is kept if it is at least as stable as the
+        //best selection among its descendants. Children follow their parents.
+        const size_t num_clusters = birth.size();
+        std::vector<double> subtree(num_clusters, 0.0);
+        std::vector<char> selected(num_clusters, 0);
+        for (size_t c = num_clusters; c-- > 1;) {
+            if (stability[c] >= subtree[c]) {
+                selected[c] = 1;
+                subtree[c] = stability[c];
+            }
+            subtree[cluster_parent[c]] += subtree[c];
+        }
+
+        std::vector<long> final_cluster(num_clusters, -1);
+        long num_final = 0;
+        for (size_t c = 1; c < num_clusters; ++c) {
+            const long above = final_cluster[cluster_parent[c]];
+            if (above >= 0)
+                final_cluster[c] = above;
+            else if (selected[c])
+                final_cluster[c] = num_final++;
+        }
+        clusters.resize(num_final);
+
+        for (size_t i = 0; i < n; ++i) {
+            label[i] = final_cluster[falls_from[i]];
+            if (label[i] >= 0)
+                clusters[label[i]].push_back(dataset[i]);
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        if (label[i] < 0)
+            negatives.push_back(dataset[i]);
+    }
+    if (labels)
+        *labels = label;
+
+    return clusters;
+}
+
+}// end of namespace
+
+
+
+#endif // CLUSTERING_HDBSCAN
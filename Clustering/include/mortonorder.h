@@ -0,0 +1,272 @@
+/*  Locality preserving reordering of 2D points. Points are
+ *  sorted along a Z-order (Morton) curve over eps sized grid
+ *  cells and kept as float arrays, so the points of a cell are
+ *  contiguous and neighbouring cells lie close in memory.
+ */
+
+#pragma once
+
+#ifndef CLUSTERING_MORTON
+#define CLUSTERING_MORTON
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "clustering.h"
+
+
+
+namespace clustering {
+
+namespace detail {
+
+/**
+ * Spreads the bits of v to the even bit positions
+ */
+inline uint64_t spreadBits(uint32_t v)
+{
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8))  & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2))  & 0x3333333333333333ull;
+    x = (x | (x << 1))  & 0x5555555555555555ull;
+    return x;
+}
+
+inline uint64_t mortonKey(uint32_t cx, uint32_t cy)
+{
+    return spreadBits(cx) | (spreadBits(cy) << 1);
+}
+
+}
+
+/**
+ * Points in Morton order, structure of arrays
+ */
+struct morton_layout {
+    /**
+     * order[i] is the index in the dataset of sorted point i
+     */
+    std::vector<uint32_t> order;
+
+    /**
+     * Coordinates relative to origin, float keeps the scans compact
+     */
+    std::vector<float> xs;
+    std::vector<float> ys;
+    double origin_x = 0.0;
+    double origin_y = 0.0;
+    double cell_size = 1.0;
+
+    /**
+     * Grid cells in Morton order: key, first point and end of its points
+     */
+    std::vector<uint64_t> cell_keys;
+    std::vector<uint32_t> cell_begin;
+
+    size_t size() const {
+        return order.size();
+    }
+
+    size_t numCells() const {
+        return cell_keys.size();
+    }
+
+    /**
+     * @brief gather    Copies the dataset into Morton order, e.g. for Cluster.
+     */
+    template <typename T>
+    std::vector<T> gather(T const* dataset) const {
+        std::vector<T> sorted(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            sorted[i] = dataset[order[i]];
+        return sorted;
+    }
+
+    /**
+     * @brief scatter   Maps values of the sorted points, e.g. labels, back to
+     *                  the dataset order.
+     */
+    template <typename V>
+    std::vector<V> scatter(std::vector<V> const& sorted) const {
+        std::vector<V> values(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            values[order[i]] = sorted[i];
+        return values;
+    }
+};
+
+/**
+ * @brief MortonLayout  Sorts points with x and y members by the Morton key of
+ *                      their cell_size grid cell.
+ */
+template <typename T>
+morton_layout MortonLayout(T const* dataset, size_t const dataset_size, double const cell_size)
+{
+    if (!(cell_size > 0))
+        throw std::invalid_argument("MortonLayout: cell_size must be positive!");
+    if (dataset_size > UINT32_MAX)
+        throw std::invalid_argument("MortonLayout: too many points!");
+
+    morton_layout layout;
+    layout.cell_size = cell_size;
+    if (dataset_size == 0)
+        return layout;
+
+    double min_x = dataset[0].x, min_y = dataset[0].y;
+    for (size_t i = 1; i < dataset_size; ++i) {
+        min_x = std::min(min_x, static_cast<double>(dataset[i].x));
+        min_y = std::min(min_y, static_cast<double>(dataset[i].y));
+    }
+    layout.origin_x = min_x;
+    layout.origin_y = min_y;
+
+    std::vector<std::pair<uint64_t, uint32_t>> keys(dataset_size);
+    for (size_t i = 0; i < dataset_size; ++i) {
+        const double cx = std::floor((dataset[i].x - min_x) / cell_size);
+        const double cy = std::floor((dataset[i].y - min_y) / cell_size);
+        const uint32_t qx = static_cast<uint32_t>(std::min(cx, 4294967295.0));
+        const uint32_t qy = static_cast<uint32_t>(std::min(cy, 4294967295.0));
+        keys[i] = std::make_pair(detail::mortonKey(qx, qy), static_cast<uint32_t>(i));
+    }
+    std::sort(keys.begin(), keys.end());
+
+    layout.order.resize(dataset_size);
+    layout.xs.resize(dataset_size);
+    layout.ys.resize(dataset_size);
+    for (size_t i = 0; i < dataset_size; ++i) {
+        const uint32_t j = keys[i].second;
+        layout.order[i] = j;
+        layout.xs[i] = static_cast<float>(dataset[j].x - min_x);
+        layout.ys[i] = static_cast<float>(dataset[j].y - min_y);
+        if (i == 0 || keys[i].first != keys[i - 1].first) {
+            layout.cell_keys.push_back(keys[i].first);
+            layout.cell_begin.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    layout.cell_begin.push_back(static_cast<uint32_t>(dataset_size));
+    return layout;
+}
+
+/**
+ * @brief ClusterMorton     Clusters like Cluster with the euclidean distance, on the
+ *                          Morton layout of the points with cells of eps: a point's
+ *                          neighbours are in the 3x3 cells around it, each a
+ *                          contiguous range of the float arrays, and clusters are
+ *                          expanded in layout order. Distances are evaluated in
+ *                          float relative to the lower left point. T needs x and y
+ *                          members, like cv::Point2d.
+ * @param labels            If given, receives the cluster index of every point in
+ *                          dataset order, -1 for outliers.
+ * @return                  The function returns the vector of clusters.
+ */
+template <typename T>
+std::vector<cluster<T>> ClusterMorton(T* const& dataset,
+                                      cluster<T>& negatives,
+                                      size_t const dataset_size,
+                                      double const eps,
+                                      size_t const min_pts,
+                                      std::vector<long>* labels = nullptr)
+{
+    const morton_layout layout = MortonLayout(dataset, dataset_size, eps);
+    const size_t n = layout.size();
+    const size_t num_cells = layout.numCells();
+
+    //The up to 9 cells around every cell, found once per cell
+    std::vector<uint32_t> near_begin(num_cells + 1, 0);
+    std::vector<uint32_t> near_cells;
+    near_cells.reserve(num_cells * 9);
+    for (size_t c = 0; c < num_cells; ++c) {
+        const uint32_t first = layout.order[layout.cell_begin[c]];
+        const int64_t cx = static_cast<int64_t>(std::floor((dataset[first].x - layout.origin_x) / eps));
+        const int64_t cy = static_cast<int64_t>(std::floor((dataset[first].y - layout.origin_y) / eps));
+        for (int64_t y = cy - 1; y <= cy + 1; ++y) {
+            for (int64_t x = cx - 1; x <= cx + 1; ++x) {
+                if (x < 0 || y < 0 || x > UINT32_MAX || y > UINT32_MAX)
+                    continue;
+                const uint64_t key = detail::mortonKey(static_cast<uint32_t>(x), static_cast<uint32_t>(y));
+                auto found = std::lower_bound(layout.cell_keys.begin(), layout.cell_keys.end(), key);
+                if (found != layout.cell_keys.end() && *found == key)
+                    near_cells.push_back(static_cast<uint32_t>(found - layout.cell_keys.begin()));
+            }
+        }
+        std::sort(near_cells.begin() + near_begin[c], near_cells.end());
+        near_begin[c + 1] = static_cast<uint32_t>(near_cells.size());
+    }
+
+    std::vector<uint32_t> cell_of(n);
+    for (size_t c = 0; c < num_cells; ++c)
+        for (uint32_t i = layout.cell_begin[c]; i < layout.cell_begin[c + 1]; ++i)
+            cell_of[i] = static_cast<uint32_t>(c);
+
+    const float eps2 = static_cast<float>(eps * eps);
+    float const* const xs = layout.xs.data();
+    float const* const ys = layout.ys.data();
+    auto forNeighbours = [&](uint32_t i, auto&& visit) {
+        const uint32_t c = cell_of[i];
+        for (uint32_t k = near_begin[c]; k < near_begin[c + 1]; ++k) {
+            const uint32_t end = layout.cell_begin[near_cells[k] + 1];
+            for (uint32_t j = layout.cell_begin[near_cells[k]]; j < end; ++j) {
+                const float dx = xs[i] - xs[j];
+                const float dy = ys[i] - ys[j];
+                if (dx * dx + dy * dy < eps2 && j != i)
+                    visit(j);
+            }
+        }
+    };
+
+    std::vector<char> core(n, 0);
+    for (uint32_t i = 0; i < n; ++i) {
+        size_t count = 0;
+        forNeighbours(i, [&](uint32_t) { ++count; });
+        core[i] = count >= min_pts;
+    }
+
+    std::vector<long> sorted_labels(n, -1);
+    std::vector<uint32_t> pending;
+    long num_clusters = 0;
+    for (uint32_t seed = 0; seed < n; ++seed) {
+        if (!core[seed] || sorted_labels[seed] >= 0) continue;
+
+        const long id = num_clusters++;
+        sorted_labels[seed] = id;
+        pending.push_back(seed);
+        while (!pending.empty()) {
+            const uint32_t i = pending.back();
+            pending.pop_back();
+            forNeighbours(i, [&](uint32_t j) {
+                if (sorted_labels[j] < 0) {
+                    sorted_labels[j] = id;
+                    if (core[j])
+                        pending.push_back(j);
+                }
+            });
+        }
+    }
+
+    std::vector<cluster<T>> clusters(num_clusters);
+    for (uint32_t i = 0; i < n; ++i) {
+        if (sorted_labels[i] >= 0)
+            clusters[sorted_labels[i]].push_back(dataset[layout.order[i]]);
+    }
+
+    std::vector<long> label = layout.scatter(sorted_labels);
+    for (size_t i = 0; i < n; ++i) {
+        if (label[i] < 0)
+            negatives.push_back(dataset[i]);
+    }
+    if (labels)
+        *labels = label;
+
+    return clusters;
+}
+
+}// end of namespace
+
+
+
+#endif // CLUSTERING_MORTON
@@ -0,0 +1,564 @@
+/*  Out-of-core density based clustering of 2D point sets
+ *  larger than memory. Points are partitioned into square
+ *  shards on disk, every shard is clustered on its own and
+ *  the shard clusters are merged across the shard borders.
+ */
+
+#pragma once
+
+#ifndef CLUSTERING_OUTOFCORE
+#define CLUSTERING_OUTOFCORE
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+
+namespace clustering {
+
+/**
+ * Point record as stored in the shard files
+ */
+struct shard_record {
+    uint64_t id;
+    double x;
+    double y;
+};
+
+/**
+ * Result of a shard for one of its own points. label is the cluster
+ * within the shard, -1 for noise.
+ */
+struct shard_label {
+    uint64_t id;
+    int32_t label;
+    int32_t core;
+};
+
+/**
+ * A halo point within eps of a core point of the shard's cluster label.
+ */
+struct shard_edge {
+    uint64_t id;
+    int64_t label;
+};
+
+
+namespace detail {
+
+inline FILE* openFile(std::string const& path, const char* mode)
+{
+    FILE* file = fopen(path.c_str(), mode);
+    if (!file)
+        throw std::runtime_error("OutOfCoreDBSCAN: cannot open " + path);
+    return file;
+}
+
+template <typename R>
+void writeRecords(std::string const& path, const char* mode, R const* records, size_t count)
+{
+    FILE* file = openFile(path, mode);
+    const size_t written = count ? fwrite(records, sizeof(R), count, file) : 0;
+    const bool failed = fclose(file) != 0 || written != count;
+    if (failed)
+        throw std::runtime_error("OutOfCoreDBSCAN: cannot write " + path);
+}
+
+/**
+ * @brief readRecords   Reads a file of records in chunks, skipping header_bytes
+ *                      first, and passes every chunk to process.
+ */
+template <typename R>
+void readRecords(std::string const& path, size_t header_bytes,
+                 std::function<void(R const*, size_t)> const& process)
+{
+    FILE* file = openFile(path, "rb");
+    std::vector<R> chunk(4096);
+    if (header_bytes && fseek(file, static_cast<long>(header_bytes), SEEK_SET) != 0) {
+        fclose(file);
+        throw std::runtime_error("OutOfCoreDBSCAN: cannot read " + path);
+    }
+    size_t count;
+    while ((count = fread(chunk.data(), sizeof(R), chunk.size(), file)) > 0)
+        process(chunk.data(), count);
+    fclose(file);
+}
+
+template <typename R>
+std::vector<R> readAllRecords(std::string const& path)
+{
+    std::vector<R> records;
+    readRecords<R>(path, 0, [&](R const* r, size_t count) { records.insert(records.end(), r, r + count); });
+    return records;
+}
+
+inline uint64_t cellKey(int64_t cx, int64_t cy)
+{
+    return (static_cast<uint64_t>(cx) << 32) ^ (static_cast<uint64_t>(cy) & 0xffffffffu);
+}
+
+/**
+ * Disjoint sets of the global cluster labels
+ */
+class union_find {
+public:
+    explicit union_find(size_t size) : parent(size) {
+        for (size_t i = 0; i < size; ++i)
+            parent[i] = i;
+    }
+
+    size_t find(size_t i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    void unite(size_t a, size_t b) {
+        a = find(a);
+        b = find(b);
+        if (a != b)
+            parent[std::max(a, b)] = std::min(a, b);
+    }
+
+private:
+    std::vector<size_t> parent;
+};
+
+}
+
+
+/**
+ * @brief The OutOfCoreDBSCAN class Clusters 2D points with the euclidean
+ *          distance like Cluster does, a point being core if at least min_pts
+ *          other points are closer than eps, without holding the points in
+ *          memory:
+ *
+ *          1. add() sorts the points into shard_size x shard_size shards on
+ *             disk. Points closer than eps to a neighbouring shard are also
+ *             written to that shard's halo.
+ *          2. clusterShard() clusters the points of one shard with a grid of
+ *             eps cells. The halo completes the neighbourhoods, so the core
+ *             points of a shard are exact. Only the shard's own points expand
+ *             clusters; halo points next to a core point are recorded as
+ *             edges. Shards are independent and may be clustered in parallel
+ *             threads (clusterShards) or processes sharing work_dir.
+ *          3. merge() joins shard clusters with a union-find wherever an edge
+ *             reaches a core point of the other shard and streams the final
+ *             labels.
+ *
+ *          Core points and clusters are the ones of in-memory DBSCAN. As
+ *          always with DBSCAN, a border point close to several clusters
+ *          belongs to either of them. Memory holds one shard at a time plus
+ *          the edges, i.e. the points along the shard borders.
+ * \code
+ *          clustering::OutOfCoreDBSCAN job("/scratch/gps", 20.0, 4, 10000.0);
+ *          while (reader >> x >> y)
+ *              job.add(x, y);
+ *          job.finishPartition();
+ *          job.clusterShards();
+ *          job.merge([&](uint64_t id, long long label) { ... });
+ * \endcode
+ */
+class OutOfCoreDBSCAN {
+public:
+    /**
+     * @param work_dir          Existing directory for the shard files. A new job
+     *                          needs an empty directory. If it holds a finished
+     *                          partition, that is reused, e.g. by a process
+     *                          clustering some of the shards; its eps and
+     *                          shard_size must be the ones given here.
+     * @param eps               The minimum distance between the neighborhood points
+     * @param min_pts           The minimum number of points in the neighborhood
+     * @param shard_size        Side of a shard, at least eps. A shard should fit
+     *                          into memory.
+     * @param buffered_points   Points buffered in memory during partitioning
+     */
+    OutOfCoreDBSCAN(std::string const& work_dir, double eps, size_t min_pts, double shard_size,
+                    size_t buffered_points = 1 << 20)
+        : m_workDir(work_dir), m_eps(eps), m_minPts(min_pts), m_shardSize(shard_size),
+          m_bufferedPoints(std::max<size_t>(buffered_points, 1)), m_numBuffered(0),
+          m_numPoints(0), m_partitioned(false)
+    {
+        if (!(eps > 0) || !(shard_size >= eps))
+            throw std::invalid_argument("OutOfCoreDBSCAN: eps must be positive and at most shard_size!");
+
+        FILE* manifest = fopen(path("manifest").c_str(), "r");
+        if (manifest) {
+            //The halos were cut for the eps and shard_size of the partition
+            double manifest_eps, manifest_shard_size;
+            unsigned long long num_points;
+            if (fscanf(manifest, "%lf %lf %llu", &manifest_eps, &manifest_shard_size, &num_points) != 3) {
+                fclose(manifest);
+                throw std::runtime_error("OutOfCoreDBSCAN: cannot read " + path("manifest"));
+            }
+            if (manifest_eps != eps || manifest_shard_size != shard_size) {
+                fclose(manifest);
+                throw std::invalid_argument("OutOfCoreDBSCAN: work_dir holds a partition with another eps or shard_size!");
+            }
+            m_numPoints = num_points;
+
+            long long cx, cy;
+            while (fscanf(manifest, "%lld %lld", &cx, &cy) == 2)
+                m_shards.push_back(std::make_pair(cx, cy));
+            fclose(manifest);
+            m_partitioned = true;
+        }
+    }
+
+    /**
+     * @brief add   Adds the next point. Its id is the number of points added before.
+     */
+    void add(double x, double y) {
+        if (m_partitioned)
+            throw std::logic_error("OutOfCoreDBSCAN: add after finishPartition, or work_dir is not empty!");
+
+        const shard_record record = { m_numPoints++, x, y };
+        const int64_t cx = static_cast<int64_t>(std::floor(x / m_shardSize));
+        const int64_t cy = static_cast<int64_t>(std::floor(y / m_shardSize));
+
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                if (dx == 0 && dy == 0) {
+                    buffer(cx, cy).points.push_back(record);
+                    ++m_numBuffered;
+                    continue;
+                }
+                //Distance to the neighbouring shard
+                const double ddx = dx < 0 ? x - cx * m_shardSize : dx > 0 ? (cx + 1) * m_shardSize - x : 0.0;
+                const double ddy = dy < 0 ? y - cy * m_shardSize : dy > 0 ? (cy + 1) * m_shardSize - y : 0.0;
+                if (ddx * ddx + ddy * ddy <= m_eps * m_eps) {
+                    buffer(cx + dx, cy + dy).halo.push_back(record);
+                    ++m_numBuffered;
+                }
+            }
+        }
+
+        if (m_numBuffered >= m_bufferedPoints)
+            flushBuffers();
+    }
+
+    /**
+     * @brief finishPartition Writes the remaining points and the manifest:
+     *          eps, shard_size, the number of points and the list of shards.
+     */
+    void finishPartition() {
+        if (m_partitioned)
+            return;
+        flushBuffers();
+
+        FILE* manifest = detail::openFile(path("manifest"), "w");
+        fprintf(manifest, "%.17g %.17g %llu\n", m_eps, m_shardSize, static_cast<unsigned long long>(m_numPoints));
+        for (std::pair<int64_t, int64_t> const& s : m_shards)
+            fprintf(manifest, "%lld %lld\n", static_cast<long long>(s.first), static_cast<long long>(s.second));
+        fclose(manifest);
+
+        m_buffers.clear();
+        m_partitioned = true;
+    }
+
+    size_t numShards() const {
+        return m_shards.size();
+    }
+
+    uint64_t numPoints() const {
+        return m_numPoints;
+    }
+
+    /**
+     * @brief clusterShard  Clusters one shard and writes its labels and edges.
+     */
+    void clusterShard(size_t shard) const {
+        if (!m_partitioned || shard >= m_shards.size())
+            throw std::logic_error("OutOfCoreDBSCAN: no such shard!");
+
+        std::vector<shard_record> points = readShard(shard, ".pts");
+        const size_t num_own = points.size();
+        std::vector<shard_record> halo = readShard(shard, ".halo");
+        points.insert(points.end(), halo.begin(), halo.end());
+        halo = std::vector<shard_record>();
+
+        //Grid of eps cells over own and halo points
+        std::unordered_map<uint64_t, std::vector<uint32_t>> grid;
+        for (size_t i = 0; i < points.size(); ++i)
+            grid[cellOf(points[i])].push_back(static_cast<uint32_t>(i));
+
+        const double eps2 = m_eps * m_eps;
+        auto forNeighbours = [&](size_t i, auto&& visit) {
+            const int64_t cx = static_cast<int64_t>(std::floor(points[i].x / m_eps));
+            const int64_t cy = static_cast<int64_t>(std::floor(points[i].y / m_eps));
+            for (int64_t y = cy - 1; y <= cy + 1; ++y) {
+                for (int64_t x = cx - 1; x <= cx + 1; ++x) {
+                    auto cell = grid.find(detail::cellKey(x, y));
+                    if (cell == grid.end())
+                        continue;
+                    for (uint32_t j : cell->second) {
+                        const double dx = points[i].x - points[j].x;
+                        const double dy = points[i].y - points[j].y;
+                        if (j != i && dx * dx + dy * dy < eps2)
+                            visit(j);
+                    }
+                }
+            }
+        };
+
+        std::vector<char> core(num_own, 0);
+        for (size_t i = 0; i < num_own; ++i) {
+            size_t count = 0;
+            forNeighbours(i, [&](uint32_t) { ++count; });
+            core[i] = count >= m_minPts;
+        }
+
+        std::vector<int32_t> labels(num_own, -1);
+        std::vector<int32_t> halo_label(points.size() - num_own, -1);
+        std::vector<shard_edge> edges;
+        std::vector<uint32_t> stack;
+        int32_t num_clusters = 0;
+
+        for (size_t seed = 0; seed < num_own; ++seed) {
+            if (!core[seed] || labels[seed] >= 0)
+                continue;
+
+            const int32_t label = num_clusters++;
+            labels[seed] = label;
+            stack.push_back(static_cast<uint32_t>(seed));
+            while (!stack.empty()) {
+                const uint32_t i = stack.back();
+                stack.pop_back();
+                forNeighbours(i, [&](uint32_t j) {
+                    if (j >= num_own) {
+                        if (halo_label[j - num_own] != label) {
+                            halo_label[j - num_own] = label;
+                            edges.push_back(shard_edge{ points[j].id, label });
+                        }
+                    } else if (labels[j] < 0) {
+                        labels[j] = label;
+                        if (core[j])
+                            stack.push_back(j);
+                    }
+                });
+            }
+        }
+
+        std::vector<shard_label> results(num_own);
+        for (size_t i = 0; i < num_own; ++i)
+            results[i] = shard_label{ points[i].id, labels[i], core[i] };
+
+        const uint64_t header = static_cast<uint64_t>(num_clusters);
+        detail::writeRecords(shardPath(shard, ".labels"), "wb", &header, 1);
+        detail::writeRecords(shardPath(shard, ".labels"), "ab", results.data(), results.size());
+        detail::writeRecords(shardPath(shard, ".edges"), "wb", edges.data(), edges.size());
+    }
+
+    /**
+     * @brief clusterShards Clusters all shards on num_threads threads,
+     *                      0 for one per core.
+     */
+    void clusterShards(unsigned num_threads = 0) const {
+        if (num_threads == 0)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::atomic<size_t> next(0);
+        std::exception_ptr error;
+        std::atomic<bool> failed(false);
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&] {
+                for (size_t s = next++; s < m_shards.size() && !failed; s = next++) {
+                    try {
+                        clusterShard(s);
+                    } catch (...) {
+                        if (!failed.exchange(true))
+                            error = std::current_exception();
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    /**
+     * @brief merge     Joins the shard clusters and calls labels for every point
+     *                  with its cluster, numbered from 0, or -1 for noise.
+     *                  Points come in shard order.
+     * @return          The number of clusters
+     */
+    size_t merge(std::function<void(uint64_t id, long long label)> const& labels) const {
+        if (!m_partitioned)
+            throw std::logic_error("OutOfCoreDBSCAN: merge before finishPartition!");
+
+        //Shard clusters are numbered consecutively over all shards
+        std::vector<size_t> offsets(m_shards.size() + 1, 0);
+        for (size_t s = 0; s < m_shards.size(); ++s) {
+            uint64_t count = 0;
+            FILE* file = detail::openFile(shardPath(s, ".labels"), "rb");
+            const bool ok = fread(&count, sizeof(count), 1, file) == 1;
+            fclose(file);
+            if (!ok)
+                throw std::runtime_error("OutOfCoreDBSCAN: cannot read " + shardPath(s, ".labels"));
+            offsets[s + 1] = offsets[s] + count;
+        }
+
+        //State of every halo point referenced by an edge
+        struct halo_state {
+            long long label = -1;
+            bool core = false;
+        };
+        std::unordered_map<uint64_t, halo_state> halo;
+        std::vector<std::pair<uint64_t, size_t>> edges;
+        for (size_t s = 0; s < m_shards.size(); ++s) {
+            detail::readRecords<shard_edge>(shardPath(s, ".edges"), 0, [&](shard_edge const* e, size_t count) {
+                for (size_t i = 0; i < count; ++i) {
+                    halo[e[i].id];
+                    edges.push_back(std::make_pair(e[i].id, offsets[s] + static_cast<size_t>(e[i].label)));
+                }
+            });
+        }
+        for (size_t s = 0; s < m_shards.size(); ++s) {
+            detail::readRecords<shard_label>(shardPath(s, ".labels"), sizeof(uint64_t), [&](shard_label const* l, size_t count) {
+                for (size_t i = 0; i < count; ++i) {
+                    auto h = halo.find(l[i].id);
+                    if (h == halo.end())
+                        continue;
+                    h->second.core = l[i].core != 0;
+                    h->second.label = l[i].label < 0 ? -1 : static_cast<long long>(offsets[s] + l[i].label);
+                }
+            });
+        }
+
+        //Core points join clusters, noise next to a core point becomes border
+        detail::union_find sets(offsets.back());
+        std::unordered_map<uint64_t, size_t> border;
+        for (std::pair<uint64_t, size_t> const& e : edges) {
+            halo_state const& h = halo[e.first];
+            if (h.core)
+                sets.unite(static_cast<size_t>(h.label), e.second);
+            else if (h.label < 0)
+                border.insert(e);
+        }
+        halo.clear();
+        edges = std::vector<std::pair<uint64_t, size_t>>();
+
+        std::vector<long long> dense(offsets.back(), -1);
+        long long num_clusters = 0;
+        for (size_t s = 0; s < m_shards.size(); ++s) {
+            detail::readRecords<shard_label>(shardPath(s, ".labels"), sizeof(uint64_t), [&](shard_label const* l, size_t count) {
+                for (size_t i = 0; i < count; ++i) {
+                    long long label = -1;
+                    size_t global = 0;
+                    bool clustered = false;
+                    if (l[i].label >= 0) {
+                        global = offsets[s] + l[i].label;
+                        clustered = true;
+                    } else {
+                        auto b = border.find(l[i].id);
+                        if (b != border.end()) {
+                            global = b->second;
+                            clustered = true;
+                        }
+                    }
+                    if (clustered) {
+                        const size_t root = sets.find(global);
+                        if (dense[root] < 0)
+                            dense[root] = num_clusters++;
+                        label = dense[root];
+                    }
+                    labels(l[i].id, label);
+                }
+            });
+        }
+        return static_cast<size_t>(num_clusters);
+    }
+
+private:
+    struct shard_buffer {
+        size_t index;
+        bool written;
+        std::vector<shard_record> points;
+        std::vector<shard_record> halo;
+    };
+
+    std::string path(std::string const& name) const {
+        return m_workDir + "/" + name;
+    }
+
+    std::string shardPath(size_t shard, const char* suffix) const {
+        return path("shard_" + std::to_string(shard) + suffix);
+    }
+
+    shard_buffer& buffer(int64_t cx, int64_t cy) {
+        auto it = m_buffers.find(detail::cellKey(cx, cy));
+        if (it != m_buffers.end())
+            return it->second;
+
+        shard_buffer& b = m_buffers[detail::cellKey(cx, cy)];
+        b.index = m_shards.size();
+        b.written = false;
+        m_shards.push_back(std::make_pair(cx, cy));
+        return b;
+    }
+
+    /**
+     * @brief flushBuffers  Appends the buffered points to the shard files. The
+     *                      first write of a shard truncates stale files.
+     */
+    void flushBuffers() {
+        for (auto& entry : m_buffers) {
+            shard_buffer& b = entry.second;
+            if (b.written && b.points.empty() && b.halo.empty())
+                continue;
+            const char* mode = b.written ? "ab" : "wb";
+            detail::writeRecords(shardPath(b.index, ".pts"), mode, b.points.data(), b.points.size());
+            detail::writeRecords(shardPath(b.index, ".halo"), mode, b.halo.data(), b.halo.size());
+            b.written = true;
+            b.points.clear();
+            b.halo.clear();
+        }
+        m_numBuffered = 0;
+    }
+
+    std::vector<shard_record> readShard(size_t shard, const char* suffix) const {
+        return detail::readAllRecords<shard_record>(shardPath(shard, suffix));
+    }
+
+    uint64_t cellOf(shard_record const& p) const {
+        return detail::cellKey(static_cast<int64_t>(std::floor(p.x / m_eps)),
+                               static_cast<int64_t>(std::floor(p.y / m_eps)));
+    }
+
+    std::string m_workDir;
+    double m_eps;
+    size_t m_minPts;
+    double m_shardSize;
+    size_t m_bufferedPoints;
+    size_t m_numBuffered;
+    uint64_t m_numPoints;
+    bool m_partitioned;
+
+    /**
+     * Shard cells in the order of the shard files
+     */
+    std::vector<std::pair<int64_t, int64_t>> m_shards;
+    std::unordered_map<uint64_t, shard_buffer> m_buffers;
+};
+
+}// end of namespace
+
+
+
+#endif // CLUSTERING_OUTOFCORE
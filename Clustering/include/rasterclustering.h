@@ -0,0 +1,273 @@
+/*  Density based clustering of pixel positions directly on
+ *  the image grid. Neighbourhoods are disks of pixels, counted
+ *  with row wise running sums instead of distances between
+ *  points, and clusters are grown over runs of core pixels.
+ */
+
+#pragma once
+
+#ifndef CLUSTERING_RASTER
+#define CLUSTERING_RASTER
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+
+
+namespace clustering {
+
+namespace detail {
+
+/**
+ * Horizontal run of core pixels [x0, x1] in a row
+ */
+struct pixel_run {
+    int x0;
+    int x1;
+};
+
+/**
+ * @brief diskHalfWidths    half_width[dy] is the largest dx with dx^2 + dy^2 < eps^2,
+ *                          for every row offset dy of the disk.
+ */
+inline std::vector<int> diskHalfWidths(double eps)
+{
+    std::vector<int> half_width;
+    const double eps2 = eps * eps;
+    for (int dy = 0; static_cast<double>(dy) * dy < eps2; ++dy) {
+        int dx = static_cast<int>(std::sqrt(std::max(0.0, eps2 - static_cast<double>(dy) * dy)));
+        while (dx > 0 && static_cast<double>(dx) * dx + static_cast<double>(dy) * dy >= eps2)
+            --dx;
+        while (static_cast<double>(dx + 1) * (dx + 1) + static_cast<double>(dy) * dy < eps2)
+            ++dx;
+        half_width.push_back(dx);
+    }
+    return half_width;
+}
+
+inline size_t findRoot(std::vector<size_t>& parent, size_t i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * @brief clusterRaster Clusters a raster holding the number of points at every
+ *                      pixel. Writes 1..N for clusters, -1 for noise and 0 where
+ *                      there are no points to labels and returns N.
+ */
+inline int clusterRaster(std::vector<int> const& counts, cv::Size const& size, cv::Mat& labels,
+                         double eps, size_t min_pts)
+{
+    const int width = size.width;
+    const int height = size.height;
+    const std::vector<int> half_width = diskHalfWidths(eps);
+    const int radius = static_cast<int>(half_width.size()) - 1;
+
+    //Row wise running sums, sums[y * (width + 1) + x] counts pixels left of x
+    const int stride = width + 1;
+    std::vector<int64_t> sums(static_cast<size_t>(stride) * height, 0);
+    for (int y = 0; y < height; ++y) {
+        int64_t* const row = &sums[static_cast<size_t>(y) * stride];
+        int const* const c = &counts[static_cast<size_t>(y) * width];
+        for (int x = 0; x < width; ++x)
+            row[x + 1] = row[x] + c[x];
+    }
+
+    auto diskSum = [&](int x, int y) {
+        int64_t total = 0;
+        for (int dy = -radius; dy <= radius; ++dy) {
+            const int yy = y + dy;
+            if (yy < 0 || yy >= height)
+                continue;
+            const int w = half_width[std::abs(dy)];
+            int64_t const* const row = &sums[static_cast<size_t>(yy) * stride];
+            total += row[std::min(x + w + 1, width)] - row[std::max(x - w, 0)];
+        }
+        return total;
+    };
+
+    //Core pixels, the other points of the pixel itself are neighbours too
+    std::vector<uint8_t> core(static_cast<size_t>(width) * height, 0);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            if (counts[i] > 0 && diskSum(x, y) - 1 >= static_cast<int64_t>(min_pts))
+                core[i] = 1;
+        }
+    }
+
+    //Runs of core pixels, single pixels if neighbouring pixels are not within eps
+    const bool join_adjacent = radius >= 0 && half_width[0] >= 1;
+    std::vector<std::vector<pixel_run>> runs(height);
+    std::vector<size_t> first_run(height + 1, 0);
+    for (int y = 0; y < height; ++y) {
+        uint8_t const* const c = &core[static_cast<size_t>(y) * width];
+        for (int x = 0; x < width; ++x) {
+            if (!c[x])
+                continue;
+            if (join_adjacent && !runs[y].empty() && runs[y].back().x1 == x - 1)
+                runs[y].back().x1 = x;
+            else
+                runs[y].push_back(pixel_run{ x, x });
+        }
+        first_run[y + 1] = first_run[y] + runs[y].size();
+    }
+
+    //Join runs closer than eps: in the same row and up to radius rows below
+    std::vector<size_t> parent(first_run[height]);
+    for (size_t i = 0; i < parent.size(); ++i)
+        parent[i] = i;
+    auto unite = [&](size_t a, size_t b) {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if (a != b)
+            parent[std::max(a, b)] = std::min(a, b);
+    };
+
+    for (int y = 0; y < height; ++y) {
+        std::vector<pixel_run> const& upper = runs[y];
+        for (size_t a = 0; a + 1 < upper.size(); ++a) {
+            if (upper[a + 1].x0 - upper[a].x1 <= half_width[0])
+                unite(first_run[y] + a, first_run[y] + a + 1);
+        }
+        for (int dy = 1; dy <= radius && y + dy < height; ++dy) {
+            std::vector<pixel_run> const& lower = runs[y + dy];
+            const int w = half_width[dy];
+            size_t start = 0;
+            for (size_t a = 0; a < upper.size(); ++a) {
+                while (start < lower.size() && lower[start].x1 < upper[a].x0 - w)
+                    ++start;
+                for (size_t b = start; b < lower.size() && lower[b].x0 <= upper[a].x1 + w; ++b)
+                    unite(first_run[y] + a, first_run[y + dy] + b);
+            }
+        }
+    }
+
+    //Clusters are numbered in raster order
+    labels.create(size, CV_32SC1);
+    std::vector<int> cluster_of(parent.size(), 0);
+    int num_clusters = 0;
+    for (int y = 0; y < height; ++y) {
+        int* const out = labels.ptr<int>(y);
+        for (int x = 0; x < width; ++x)
+            out[x] = counts[static_cast<size_t>(y) * width + x] > 0 ? -1 : 0;
+        for (size_t a = 0; a < runs[y].size(); ++a) {
+            const size_t root = findRoot(parent, first_run[y] + a);
+            if (cluster_of[root] == 0)
+                cluster_of[root] = ++num_clusters;
+            for (int x = runs[y][a].x0; x <= runs[y][a].x1; ++x)
+                out[x] = cluster_of[root];
+        }
+    }
+
+    //Border pixels join the cluster of a core pixel in their disk, nearest rows first
+    std::vector<int64_t> core_sums(sums.size(), 0);
+    for (int y = 0; y < height; ++y) {
+        int64_t* const row = &core_sums[static_cast<size_t>(y) * stride];
+        uint8_t const* const c = &core[static_cast<size_t>(y) * width];
+        for (int x = 0; x < width; ++x)
+            row[x + 1] = row[x] + c[x];
+    }
+
+    for (int y = 0; y < height; ++y) {
+        int* const out = labels.ptr<int>(y);
+        for (int x = 0; x < width; ++x) {
+            if (out[x] != -1)
+                continue;
+            for (int d = 0; d <= 2 * radius && out[x] == -1; ++d) {
+                const int dy = (d & 1) ? -(d + 1) / 2 : d / 2;
+                const int yy = y + dy;
+                if (yy < 0 || yy >= height)
+                    continue;
+                const int w = half_width[std::abs(dy)];
+                const int x0 = std::max(x - w, 0);
+                const int x1 = std::min(x + w + 1, width);
+                int64_t const* const row = &core_sums[static_cast<size_t>(yy) * stride];
+                if (row[x1] == row[x0])
+                    continue;
+                uint8_t const* const c = &core[static_cast<size_t>(yy) * width];
+                int const* const near_labels = labels.ptr<int>(yy);
+                for (int xx = x0; xx < x1; ++xx) {
+                    if (c[xx]) {
+                        out[x] = near_labels[xx];
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return num_clusters;
+}
+
+}
+
+
+/**
+ * @brief ClusterMask   Clusters the foreground pixels of a mask like Cluster
+ *                      clusters their positions with the euclidean distance,
+ *                      without extracting points. Runs in O(area * eps).
+ * @param mask          8 bit single channel, non zero pixels are foreground
+ * @param labels        CV_32S label image: 1..N clusters, -1 noise, 0 background
+ * @param eps           The minimum distance between the neghborhood pixels
+ * @param min_pts       The minimum number of pixels in the neighborhood
+ * @return              The number of clusters N
+ */
+inline int ClusterMask(cv::Mat const& mask, cv::Mat& labels, double eps, size_t min_pts)
+{
+    if (mask.type() != CV_8UC1)
+        throw std::invalid_argument("ClusterMask: The mask type is invalid (!CV_8UC1)");
+
+    std::vector<int> counts(static_cast<size_t>(mask.rows) * mask.cols);
+    for (int y = 0; y < mask.rows; ++y) {
+        uint8_t const* const m = mask.ptr<uint8_t>(y);
+        for (int x = 0; x < mask.cols; ++x)
+            counts[static_cast<size_t>(y) * mask.cols + x] = m[x] != 0;
+    }
+    return detail::clusterRaster(counts, mask.size(), labels, eps, min_pts);
+}
+
+/**
+ * @brief ClusterPixels Clusters integer pixel positions inside an image of the
+ *                      given size on the grid, see ClusterMask. Repeated
+ *                      positions count as separate points, like in Cluster.
+ * @param labels        Receives the cluster of every pixel, 1..N or -1 for noise
+ * @param label_image   If given, receives the label image
+ * @return              The number of clusters N
+ */
+inline int ClusterPixels(std::vector<cv::Point> const& pixels, cv::Size const& size,
+                         std::vector<int>& labels, double eps, size_t min_pts,
+                         cv::Mat* label_image = nullptr)
+{
+    std::vector<int> counts(static_cast<size_t>(size.width) * size.height, 0);
+    for (cv::Point const& p : pixels) {
+        if (p.x < 0 || p.y < 0 || p.x >= size.width || p.y >= size.height)
+            throw std::invalid_argument("ClusterPixels: pixel outside of the image!");
+        ++counts[static_cast<size_t>(p.y) * size.width + p.x];
+    }
+
+    cv::Mat image;
+    const int num_clusters = detail::clusterRaster(counts, size, image, eps, min_pts);
+
+    labels.resize(pixels.size());
+    for (size_t i = 0; i < pixels.size(); ++i)
+        labels[i] = image.at<int>(pixels[i].y, pixels[i].x);
+    if (label_image)
+        *label_image = image;
+    return num_clusters;
+}
+
+}// end of namespace
+
+
+
+#endif // CLUSTERING_RASTER
@@ -0,0 +1,48 @@
+/*
+ * Conversion of a frame to one row of floats, channels interleaved,
+ * as in the rows of the stacked frame matrix.
+ */
+#pragma once
+
+#ifndef FLATTENFRAME_H
+#define FLATTENFRAME_H
+
+#include <stdexcept>
+#include <opencv2/core.hpp>
+
+
+template<typename T>
+void convertFrameRow(T const* src, float* dst, int count)
+{
+    for (int i = 0; i < count; ++i)
+        dst[i] = static_cast<float>(src[i]);
+}
+
+/**
+ * @brief flattenFrame Writes the rows x cols x channels values of an 8 or 16
+ *          bit unsigned, float or double frame to out.
+ */
+inline void flattenFrame(cv::Mat const& frame, float* out)
+{
+    const int count = frame.cols * frame.channels();
+    for (int y = 0; y < frame.rows; ++y, out += count) {
+        switch (frame.depth()) {
+        case CV_8U:
+            convertFrameRow(frame.ptr<uint8_t>(y), out, count);
+            break;
+        case CV_16U:
+            convertFrameRow(frame.ptr<uint16_t>(y), out, count);
+            break;
+        case CV_32F:
+            convertFrameRow(frame.ptr<float>(y), out, count);
+            break;
+        case CV_64F:
+            convertFrameRow(frame.ptr<double>(y), out, count);
+            break;
+        default:
+            throw std::invalid_argument("flattenFrame: The frame depth is not supported");
+        }
+    }
+}
+
+#endif // FLATTENFRAME_H
@@ -0,0 +1,122 @@
+/*
+ * Incremental principal component analysis of video frames. Every
+ * frame is one row of the stacked frame matrix; the rows are taken
+ * in mini batches as they are decoded and only the top components
+ * and the running mean are kept.
+ */
+#pragma once
+
+#ifndef INCREMENTALPCA_H
+#define INCREMENTALPCA_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+
+/**
+ * @brief The IncrementalPCA class Keeps the mean and the top components of
+ *          all frames pushed so far. Each mini batch is merged with the model
+ *          by the SVD of
+ *
+ *              [ S * V ; batch - batch mean ; sqrt(n b / (n + b)) (mean - batch mean) ]
+ *
+ *          whose few rows allow the SVD through their Gram matrix. Gram matrix
+ *          and new components are blocked products over the pixels, spread
+ *          across threads. Memory is O((2 * components + batch) * pixels),
+ *          independent of the length of the video.
+ *
+ *          A low rank background model for a frame is its projection onto
+ *          the components, see background().
+ */
+class IncrementalPCA
+{
+public:
+    /**
+     * @param num_components Number of components kept
+     * @param batch_size     Frames per update, 0 for twice num_components
+     * @param num_threads    0 for one per core
+     */
+    IncrementalPCA(int num_components, int batch_size = 0, int num_threads = 0);
+
+    IncrementalPCA(IncrementalPCA const&) = delete;
+    IncrementalPCA& operator=(IncrementalPCA const&) = delete;
+
+    /**
+     * @brief push Adds a frame of any depth and number of channels. All
+     *          frames must have the same size and type. The model is updated
+     *          whenever a batch is full.
+     */
+    void push(cv::Mat const& frame);
+
+    /**
+     * @brief flush Merges the frames of an incomplete batch into the model.
+     */
+    void flush();
+
+    /**
+     * @brief numSamples Number of frames in the model, buffered ones excluded.
+     */
+    long long numSamples() const {
+        return m_numSamples;
+    }
+
+    /**
+     * @brief mean 1 x pixels, CV_32F
+     */
+    cv::Mat const& mean() const {
+        return m_mean;
+    }
+
+    /**
+     * @brief components Orthonormal rows, up to num_components x pixels, CV_32F
+     */
+    cv::Mat components() const;
+
+    /**
+     * @brief singularValues The singular value of every component, CV_64F
+     */
+    cv::Mat singularValues() const;
+
+    /**
+     * @brief project Coefficients of the frame for every component, 1 x k CV_64F.
+     */
+    void project(cv::Mat const& frame, cv::Mat& coefficients) const;
+
+    /**
+     * @brief background The frame projected onto the components, same size
+     *          and type as the frame. Moving foreground is what remains of
+     *          frame - background.
+     */
+    void background(cv::Mat const& frame, cv::Mat& background) const;
+
+private:
+    void update();
+
+    int m_maxComponents;
+    int m_batchSize;
+    int m_numThreads;
+
+    /**
+     * @brief m_frameSize Size and type of the frames, fixed by the first one
+     */
+    cv::Size m_frameSize;
+    int m_frameType;
+    int m_numPixels;
+
+    long long m_numSamples;
+    int m_numComponents;
+    int m_numBuffered;
+
+    cv::Mat m_mean;
+    cv::Mat m_components;
+    std::vector<double> m_singularValues;
+
+    /**
+     * @brief m_work Rows of the matrix to decompose: max components, the
+     *      batch and the mean correction. Pushed frames go straight into
+     *      the batch rows.
+     */
+    cv::Mat m_work;
+};
+
+#endif // INCREMENTALPCA_H
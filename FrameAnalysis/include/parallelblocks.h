@@ -0,0 +1,53 @@
+/*
+ * Splits a long range, e.g. the pixels of a flattened frame, into
+ * blocks that worker threads take in turn.
+ */
+#pragma once
+
+#ifndef PARALLELBLOCKS_H
+#define PARALLELBLOCKS_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @brief resolveThreads Number of threads to use, 0 for one per core.
+ */
+inline int resolveThreads(int num_threads)
+{
+    if (num_threads > 0)
+        return num_threads;
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+/**
+ * @brief parallelBlocks Calls body(thread, begin, end) for consecutive blocks
+ *          of block_size covering [0, count) on num_threads threads. The
+ *          calling thread is thread 0.
+ */
+template<typename Body>
+void parallelBlocks(size_t count, size_t block_size, int num_threads, Body const& body)
+{
+    const size_t num_blocks = (count + block_size - 1) / block_size;
+    const int threads_used = static_cast<int>(std::min<size_t>(std::max(num_threads, 1), std::max<size_t>(num_blocks, 1)));
+
+    std::atomic<size_t> next(0);
+    auto run = [&](int thread) {
+        for (size_t b = next++; b < num_blocks; b = next++) {
+            const size_t begin = b * block_size;
+            body(thread, begin, std::min(begin + block_size, count));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threads_used; ++t)
+        threads.emplace_back(run, t);
+    run(0);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+#endif // PARALLELBLOCKS_H
@@ -0,0 +1,121 @@
+/*
+ * Running statistics of every pixel over the frames of a video:
+ * mean and variance by Welford updates, median and percentiles
+ * from a coarse histogram per pixel. The state does not grow with
+ * the number of frames.
+ */
+#pragma once
+
+#ifndef PIXELSTATS_H
+#define PIXELSTATS_H
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/core.hpp>
+
+
+/**
+ * @brief The PixelStatistics class Consumes frames one by one, e.g. from the
+ *          capture loop, and keeps per channel value
+ *
+ *              mean, sum of squared deviations   Welford, float
+ *              histogram of num_bins over range  16 bit counts
+ *
+ *          Updates are elementwise over the flattened frame and spread across
+ *          threads in blocks of pixels. Memory is (12 + 2 * num_bins) bytes
+ *          per value, the converted frame included. The median of the frames
+ *          is the usual background model; it is approximated within one bin
+ *          by interpolating in the histogram. NaN values count in bin 0.
+ *
+ *          Before a count can overflow all histograms are halved, from then on
+ *          older frames weigh less in the percentiles but not in the mean and
+ *          variance.
+ */
+class PixelStatistics
+{
+public:
+    /**
+     * @param num_bins    Histogram bins per value, 2 to 256
+     * @param range_min   Lower end of the histogram range
+     * @param range_max   Upper end, values outside go to the end bins.
+     *                    The default covers 8 bit frames.
+     * @param num_threads 0 for one per core
+     */
+    PixelStatistics(int num_bins = 32, float range_min = 0.0f, float range_max = 256.0f,
+                    int num_threads = 0);
+
+    PixelStatistics(PixelStatistics const&) = delete;
+    PixelStatistics& operator=(PixelStatistics const&) = delete;
+
+    /**
+     * @brief push Adds a frame of any depth and number of channels. All
+     *          frames must have the same size and type.
+     */
+    void push(cv::Mat const& frame);
+
+    /**
+     * @brief reset Forgets all frames, the next one may differ in size or type.
+     */
+    void reset();
+
+    long long numFrames() const {
+        return m_numFrames;
+    }
+
+    /**
+     * @brief mean Per pixel mean, frame size and channels, CV_32F
+     */
+    void mean(cv::Mat& mean) const;
+
+    /**
+     * @brief variance Per pixel sample variance, frame size and channels, CV_32F
+     */
+    void variance(cv::Mat& variance) const;
+
+    /**
+     * @brief stddev Square root of variance()
+     */
+    void stddev(cv::Mat& stddev) const;
+
+    /**
+     * @brief percentile Per pixel q-th quantile, q in [0, 1], from the
+     *          histograms. Frame size and channels, CV_32F
+     */
+    void percentile(double q, cv::Mat& percentile) const;
+
+    /**
+     * @brief median Median background model, percentile(0.5)
+     */
+    void median(cv::Mat& median) const {
+        percentile(0.5, median);
+    }
+
+private:
+    cv::Mat toFrame(std::vector<float> const& values) const;
+
+    int m_numBins;
+    float m_rangeMin;
+    float m_rangeMax;
+    int m_numThreads;
+
+    /**
+     * @brief m_frameSize Size and type of the frames, fixed by the first one
+     */
+    cv::Size m_frameSize;
+    int m_frameType;
+    size_t m_numValues;
+
+    long long m_numFrames;
+
+    std::vector<float> m_frame;
+    std::vector<float> m_mean;
+    std::vector<float> m_m2;
+
+    /**
+     * @brief m_histograms num_bins consecutive counts per value
+     */
+    std::vector<uint16_t> m_histograms;
+    int m_histogramFrames;
+};
+
+#endif // PIXELSTATS_H
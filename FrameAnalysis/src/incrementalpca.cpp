@@ -0,0 +1,246 @@
+/*
+ * Incremental principal component analysis of video frames.
+ */
+#include "incrementalpca.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "flattenframe.h"
+#include "parallelblocks.h"
+
+
+namespace {
+
+/**
+ * @brief BLOCK_SIZE Pixels per block, the rows of a block stay in cache
+ */
+const size_t BLOCK_SIZE = 4096;
+
+}
+
+
+IncrementalPCA::IncrementalPCA(int num_components, int batch_size, int num_threads) :
+    m_maxComponents(num_components),
+    m_batchSize(batch_size > 0 ? batch_size : 2 * num_components),
+    m_numThreads(resolveThreads(num_threads)),
+    m_frameType(-1),
+    m_numPixels(0),
+    m_numSamples(0),
+    m_numComponents(0),
+    m_numBuffered(0)
+{
+    if (num_components < 1)
+        throw std::invalid_argument("IncrementalPCA: at least one component is needed!");
+}
+
+
+void IncrementalPCA::push(cv::Mat const& frame)
+{
+    if (frame.empty())
+        throw std::invalid_argument("IncrementalPCA: The frame is empty");
+
+    if (m_frameType < 0) {
+        m_frameSize = frame.size();
+        m_frameType = frame.type();
+        m_numPixels = frame.cols * frame.rows * frame.channels();
+        m_mean = cv::Mat::zeros(1, m_numPixels, CV_32F);
+        m_components = cv::Mat(m_maxComponents, m_numPixels, CV_32F);
+        m_work = cv::Mat(m_maxComponents + m_batchSize + 1, m_numPixels, CV_32F);
+    } else if (frame.size() != m_frameSize || frame.type() != m_frameType) {
+        throw std::invalid_argument("IncrementalPCA: frames differ in size or type!");
+    }
+
+    flattenFrame(frame, m_work.ptr<float>(m_maxComponents + m_numBuffered));
+    if (++m_numBuffered == m_batchSize)
+        update();
+}
+
+
+void IncrementalPCA::flush()
+{
+    if (m_numBuffered > 0)
+        update();
+}
+
+
+cv::Mat IncrementalPCA::components() const
+{
+    if (m_numComponents == 0)
+        return cv::Mat();
+    return m_components.rowRange(0, m_numComponents).clone();
+}
+
+
+cv::Mat IncrementalPCA::singularValues() const
+{
+    cv::Mat values(m_numComponents, 1, CV_64F);
+    for (int q = 0; q < m_numComponents; ++q)
+        values.at<double>(q, 0) = m_singularValues[q];
+    return values;
+}
+
+
+void IncrementalPCA::update()
+{
+    const int k_old = m_numComponents;
+    const int b = m_numBuffered;
+    const double n = static_cast<double>(m_numSamples);
+    const bool has_model = m_numSamples > 0;
+    const size_t d = static_cast<size_t>(m_numPixels);
+
+    std::vector<float*> rows;
+    for (int q = 0; q < k_old; ++q)
+        rows.push_back(m_work.ptr<float>(q));
+    for (int i = 0; i < b; ++i)
+        rows.push_back(m_work.ptr<float>(m_maxComponents + i));
+    if (has_model)
+        rows.push_back(m_work.ptr<float>(m_maxComponents + m_batchSize));
+    const int r = static_cast<int>(rows.size());
+
+    // Center the batch, build the scaled components and the mean correction row.
+    const float correction = static_cast<float>(std::sqrt(n * b / (n + b)));
+    float* const mean = m_mean.ptr<float>(0);
+    parallelBlocks(d, BLOCK_SIZE, m_numThreads, [&](int, size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            float sum = 0.0f;
+            for (int i = 0; i < b; ++i)
+                sum += rows[k_old + i][c];
+            const float batch_mean = sum / b;
+            for (int i = 0; i < b; ++i)
+                rows[k_old + i][c] -= batch_mean;
+            if (has_model)
+                rows[r - 1][c] = correction * (mean[c] - batch_mean);
+            mean[c] = static_cast<float>((n * mean[c] + b * static_cast<double>(batch_mean)) / (n + b));
+        }
+        for (int q = 0; q < k_old; ++q) {
+            float const* const component = m_components.ptr<float>(q);
+            const float s = static_cast<float>(m_singularValues[q]);
+            for (size_t c = begin; c < end; ++c)
+                rows[q][c] = s * component[c];
+        }
+    });
+
+    // Gram matrix of the rows, blocked over the pixels.
+    std::vector<double> gram(static_cast<size_t>(r) * r, 0.0);
+    std::vector<std::vector<double>> partial(m_numThreads, std::vector<double>(gram.size(), 0.0));
+    parallelBlocks(d, BLOCK_SIZE, m_numThreads, [&](int thread, size_t begin, size_t end) {
+        std::vector<double>& g = partial[thread];
+        for (int i = 0; i < r; ++i) {
+            float const* const a = rows[i];
+            for (int j = 0; j <= i; ++j) {
+                float const* const bb = rows[j];
+                float dot = 0.0f;
+                for (size_t c = begin; c < end; ++c)
+                    dot += a[c] * bb[c];
+                g[i * r + j] += dot;
+            }
+        }
+    });
+    for (std::vector<double> const& g : partial)
+        for (size_t i = 0; i < gram.size(); ++i)
+            gram[i] += g[i];
+
+    cv::Mat g(r, r, CV_64F);
+    for (int i = 0; i < r; ++i) {
+        for (int j = 0; j <= i; ++j) {
+            g.at<double>(i, j) = gram[i * r + j];
+            g.at<double>(j, i) = gram[i * r + j];
+        }
+    }
+
+    // Eigenvectors of the Gram matrix are the left singular vectors.
+    cv::Mat eigenvalues, eigenvectors;
+    cv::eigen(g, eigenvalues, eigenvectors);
+
+    //Smaller eigenvalues are below the float resolution of the rows
+    const double largest = std::max(eigenvalues.at<double>(0, 0), 0.0);
+    int k_new = 0;
+    while (k_new < std::min(m_maxComponents, r) && eigenvalues.at<double>(k_new, 0) > largest * 1e-7)
+        ++k_new;
+
+    std::vector<float> weights(static_cast<size_t>(k_new) * r);
+    m_singularValues.assign(k_new, 0.0);
+    for (int q = 0; q < k_new; ++q) {
+        const double value = eigenvalues.at<double>(q, 0);
+        m_singularValues[q] = std::sqrt(value);
+        for (int i = 0; i < r; ++i)
+            weights[q * r + i] = static_cast<float>(eigenvectors.at<double>(q, i) / std::sqrt(value));
+    }
+
+    // New components, one weighted sum of the rows each.
+    parallelBlocks(d, BLOCK_SIZE, m_numThreads, [&](int, size_t begin, size_t end) {
+        for (int q = 0; q < k_new; ++q) {
+            float* const out = m_components.ptr<float>(q);
+            for (size_t c = begin; c < end; ++c)
+                out[c] = 0.0f;
+            for (int i = 0; i < r; ++i) {
+                const float w = weights[q * r + i];
+                float const* const row = rows[i];
+                for (size_t c = begin; c < end; ++c)
+                    out[c] += w * row[c];
+            }
+        }
+    });
+
+    m_numComponents = k_new;
+    m_numSamples += b;
+    m_numBuffered = 0;
+}
+
+
+void IncrementalPCA::project(cv::Mat const& frame, cv::Mat& coefficients) const
+{
+    if (m_numSamples == 0 || frame.size() != m_frameSize || frame.type() != m_frameType)
+        throw std::invalid_argument("IncrementalPCA: The frame does not match the model");
+
+    std::vector<float> x(m_numPixels);
+    flattenFrame(frame, x.data());
+
+    const int k = m_numComponents;
+    float const* const mean = m_mean.ptr<float>(0);
+    std::vector<std::vector<double>> partial(m_numThreads, std::vector<double>(k, 0.0));
+    parallelBlocks(m_numPixels, BLOCK_SIZE, m_numThreads, [&](int thread, size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c)
+            x[c] -= mean[c];
+        for (int q = 0; q < k; ++q) {
+            float const* const component = m_components.ptr<float>(q);
+            float dot = 0.0f;
+            for (size_t c = begin; c < end; ++c)
+                dot += x[c] * component[c];
+            partial[thread][q] += dot;
+        }
+    });
+
+    coefficients.create(1, k, CV_64F);
+    for (int q = 0; q < k; ++q) {
+        double sum = 0.0;
+        for (std::vector<double> const& p : partial)
+            sum += p[q];
+        coefficients.at<double>(0, q) = sum;
+    }
+}
+
+
+void IncrementalPCA::background(cv::Mat const& frame, cv::Mat& background) const
+{
+    cv::Mat coefficients;
+    project(frame, coefficients);
+
+    cv::Mat reconstruction(1, m_numPixels, CV_32F);
+    float* const out = reconstruction.ptr<float>(0);
+    float const* const mean = m_mean.ptr<float>(0);
+    parallelBlocks(m_numPixels, BLOCK_SIZE, m_numThreads, [&](int, size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c)
+            out[c] = mean[c];
+        for (int q = 0; q < m_numComponents; ++q) {
+            const float w = static_cast<float>(coefficients.at<double>(0, q));
+            float const* const component = m_components.ptr<float>(q);
+            for (size_t c = begin; c < end; ++c)
+                out[c] += w * component[c];
+        }
+    });
+
+    reconstruction.reshape(frame.channels(), frame.rows).convertTo(background, frame.depth());
+}
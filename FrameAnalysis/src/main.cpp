@@ -0,0 +1,71 @@
+#include <iostream>
+
+#include <opencv2/core.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "incrementalpca.h"
+#include "pixelstats.h"
+
+
+
+int main(int argc, char *argv[])
+{
+    cv::VideoCapture cap(argc > 1 ? argv[1] : "/home/anubhav/Desktop/video.mp4");
+
+    if(!cap.isOpened()){
+        std::cout<<"\nCannot open the video\n";
+        return -1;
+    }
+
+    //Low rank background model, updated every 16 frames
+    IncrementalPCA pca(8, 16);
+
+    //Per pixel mean, variance and median of all frames so far
+    PixelStatistics stats;
+
+    cv::Mat frame, background, foreground, median;
+
+    for(;;){
+
+        cap>>frame;
+        if(frame.empty())
+            break;
+        cv::resize(frame,frame,cv::Size(),0.3,0.3,cv::INTER_LINEAR);
+        cv::imshow("Frame",frame);
+
+        pca.push(frame);
+        stats.push(frame);
+
+        stats.median(median);
+        median.convertTo(median, frame.depth());
+        cv::imshow("Median",median);
+
+        if(pca.numSamples() > 0){
+            pca.background(frame,background);
+            cv::absdiff(frame,background,foreground);
+            cv::imshow("Background",background);
+            cv::imshow("Foreground",foreground);
+        }
+
+        char c = cv::waitKey(27);
+        if(c == 27){
+            break;
+        }
+    }
+
+    cap.release();
+    pca.flush();
+
+    std::cout<<"\nFrames in the model = "<<pca.numSamples()<<std::endl;
+    std::cout<<"\nSingular values = "<<pca.singularValues().t()<<std::endl;
+
+    if(stats.numFrames() > 0){
+        cv::Mat deviation;
+        stats.stddev(deviation);
+        std::cout<<"\nMean pixel deviation = "<<cv::mean(deviation)<<std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * Running statistics of every pixel over the frames of a video.
+ */
+#include "pixelstats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "flattenframe.h"
+#include "parallelblocks.h"
+
+
+namespace {
+
+/**
+ * @brief BLOCK_SIZE Values per block, the state of a block stays in cache
+ */
+const size_t BLOCK_SIZE = 4096;
+
+/**
+ * @brief MAX_COUNT Histograms are halved before a count could pass this
+ */
+const int MAX_COUNT = UINT16_MAX;
+
+}
+
+
+PixelStatistics::PixelStatistics(int num_bins, float range_min, float range_max, int num_threads) :
+    m_numBins(num_bins),
+    m_rangeMin(range_min),
+    m_rangeMax(range_max),
+    m_numThreads(resolveThreads(num_threads)),
+    m_frameType(-1),
+    m_numValues(0),
+    m_numFrames(0),
+    m_histogramFrames(0)
+{
+    if (num_bins < 2 || num_bins > 256)
+        throw std::invalid_argument("PixelStatistics: num_bins must be between 2 and 256!");
+    if (!(range_max > range_min))
+        throw std::invalid_argument("PixelStatistics: The histogram range is empty!");
+}
+
+
+void PixelStatistics::push(cv::Mat const& frame)
+{
+    if (frame.empty())
+        throw std::invalid_argument("PixelStatistics: The frame is empty");
+
+    if (m_frameType < 0) {
+        m_frameSize = frame.size();
+        m_frameType = frame.type();
+        m_numValues = static_cast<size_t>(frame.cols) * frame.rows * frame.channels();
+        m_frame.assign(m_numValues, 0.0f);
+        m_mean.assign(m_numValues, 0.0f);
+        m_m2.assign(m_numValues, 0.0f);
+        m_histograms.assign(m_numValues * m_numBins, 0);
+    } else if (frame.size() != m_frameSize || frame.type() != m_frameType) {
+        throw std::invalid_argument("PixelStatistics: frames differ in size or type!");
+    }
+
+    flattenFrame(frame, m_frame.data());
+
+    const bool halve = m_histogramFrames == MAX_COUNT;
+    if (halve)
+        m_histogramFrames = (MAX_COUNT + 1) / 2;
+    ++m_histogramFrames;
+    ++m_numFrames;
+
+    const float inv_n = 1.0f / static_cast<float>(m_numFrames);
+    const float bin_scale = m_numBins / (m_rangeMax - m_rangeMin);
+    const float bin_offset = -m_rangeMin * bin_scale;
+    const float last_bin = static_cast<float>(m_numBins - 1);
+    const int num_bins = m_numBins;
+
+    std::vector<std::vector<int>> bins(m_numThreads, std::vector<int>(BLOCK_SIZE));
+    parallelBlocks(m_numValues, BLOCK_SIZE, m_numThreads, [&](int thread, size_t begin, size_t end) {
+        float const* const x = m_frame.data() + begin;
+        float* const mean = m_mean.data() + begin;
+        float* const m2 = m_m2.data() + begin;
+        uint16_t* const histograms = m_histograms.data() + begin * num_bins;
+        int* const bin = bins[thread].data();
+        const size_t count = end - begin;
+
+        //Welford, elementwise and branch free
+        for (size_t i = 0; i < count; ++i) {
+            const float delta = x[i] - mean[i];
+            mean[i] += delta * inv_n;
+            m2[i] += delta * (x[i] - mean[i]);
+        }
+
+        //NaN fails the comparison and goes to bin 0
+        for (size_t i = 0; i < count; ++i) {
+            const float v = x[i] * bin_scale + bin_offset;
+            bin[i] = v >= 0.0f ? static_cast<int>(std::min(v, last_bin)) : 0;
+        }
+
+        if (halve) {
+            for (size_t i = 0; i < count * num_bins; ++i)
+                histograms[i] = static_cast<uint16_t>((histograms[i] + 1) >> 1);
+        }
+        for (size_t i = 0; i < count; ++i)
+            ++histograms[i * num_bins + bin[i]];
+    });
+}
+
+
+void PixelStatistics::reset()
+{
+    m_frameType = -1;
+    m_numValues = 0;
+    m_numFrames = 0;
+    m_histogramFrames = 0;
+    m_frame.clear();
+    m_mean.clear();
+    m_m2.clear();
+    m_histograms.clear();
+}
+
+
+cv::Mat PixelStatistics::toFrame(std::vector<float> const& values) const
+{
+    cv::Mat row(1, static_cast<int>(values.size()), CV_32F);
+    std::copy(values.begin(), values.end(), row.ptr<float>(0));
+    return row.reshape(CV_MAT_CN(m_frameType), m_frameSize.height);
+}
+
+
+void PixelStatistics::mean(cv::Mat& mean) const
+{
+    if (m_numFrames == 0)
+        throw std::invalid_argument("PixelStatistics: no frames yet");
+    mean = toFrame(m_mean);
+}
+
+
+void PixelStatistics::variance(cv::Mat& variance) const
+{
+    if (m_numFrames == 0)
+        throw std::invalid_argument("PixelStatistics: no frames yet");
+
+    std::vector<float> values(m_numValues, 0.0f);
+    if (m_numFrames > 1) {
+        const float inv = 1.0f / static_cast<float>(m_numFrames - 1);
+        for (size_t i = 0; i < m_numValues; ++i)
+            values[i] = m_m2[i] * inv;
+    }
+    variance = toFrame(values);
+}
+
+
+void PixelStatistics::stddev(cv::Mat& stddev) const
+{
+    cv::Mat v;
+    variance(v);
+    cv::sqrt(v, stddev);
+}
+
+
+void PixelStatistics::percentile(double q, cv::Mat& percentile) const
+{
+    if (m_numFrames == 0)
+        throw std::invalid_argument("PixelStatistics: no frames yet");
+    if (!(q >= 0.0 && q <= 1.0))
+        throw std::invalid_argument("PixelStatistics: q must be in [0, 1]!");
+
+    const int num_bins = m_numBins;
+    const float bin_width = (m_rangeMax - m_rangeMin) / num_bins;
+    std::vector<float> values(m_numValues);
+    parallelBlocks(m_numValues, BLOCK_SIZE, m_numThreads, [&](int, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            uint16_t const* const h = m_histograms.data() + i * num_bins;
+            int total = 0;
+            for (int b = 0; b < num_bins; ++b)
+                total += h[b];
+
+            //Walk to the bin holding the target rank, interpolate inside it
+            const double target = q * total;
+            int below = 0;
+            int b = 0;
+            while (b < num_bins - 1 && (h[b] == 0 || below + h[b] < target))
+                below += h[b++];
+            const double within = h[b] > 0 ? (target - below) / h[b] : 0.5;
+            values[i] = m_rangeMin + static_cast<float>((b + within) * bin_width);
+        }
+    });
+    percentile = toFrame(values);
+}
@@ -0,0 +1,228 @@
+/*
+ * Headless benchmarks of the Savitzky Golay smoothing on synthetic
+ * document scans. Results are written to smoothsavgol_bench.json
+ * unless --benchmark_out is given.
+ */
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <opencv2/core.hpp>
+
+#include "savitzkygolayfilter.h"
+
+
+namespace {
+
+/**
+ * @brief syntheticPage Generates a grayscale page of about megapixels
+ *          million pixels: paper background with sensor noise and dark
+ *          text like strokes. Pages are cached between benchmarks.
+ */
+const cv::Mat& syntheticPage(int megapixels)
+{
+    static std::map<int, cv::Mat> pages;
+
+    cv::Mat& page = pages[megapixels];
+    if (!page.empty())
+        return page;
+
+    //A4 aspect ratio
+    const double pixels = megapixels * 1e6;
+    const int width = static_cast<int>(std::sqrt(pixels / 1.414));
+    const int height = static_cast<int>(pixels / width);
+
+    page.create(height, width, CV_8UC1);
+    cv::RNG rng(megapixels);
+    for (int y = 0; y < height; ++y) {
+        uint8_t* line = page.ptr<uint8_t>(y);
+        //Text lines of 40 pixel pitch with 24 pixel high glyph rows
+        const bool text_row = (y % 40) < 24;
+        for (int x = 0; x < width; ++x) {
+            int val = 235 + rng.uniform(-6, 7);
+            if (text_row && (x / 12) % 3 != 0 && rng.uniform(0, 4) == 0)
+                val = 30 + rng.uniform(0, 40);
+            line[x] = static_cast<uint8_t>(val);
+        }
+    }
+    return page;
+}
+
+//Window size and degree pairs of the DPI table in savitzkygolayfilter.h
+const int CONFIGS[][2] = { {5, 3}, {7, 4}, {11, 4}, {11, 2} };
+
+void configArgs(benchmark::internal::Benchmark* b, const std::vector<int64_t>& megapixels)
+{
+    for (int64_t mp : megapixels)
+        for (int c = 0; c < 4; ++c)
+            b->Args({mp, CONFIGS[c][0], CONFIGS[c][1]});
+}
+
+}
+
+
+/**
+ * Single image, args: megapixels, window size, degree.
+ */
+static void BM_SmoothSavGolFilter(benchmark::State& state)
+{
+    const cv::Mat& src = syntheticPage(static_cast<int>(state.range(0)));
+    const cv::Size window(static_cast<int>(state.range(1)), static_cast<int>(state.range(1)));
+    const int degree = static_cast<int>(state.range(2));
+
+    cv::Mat dst;
+    for (auto _ : state) {
+        smoothSavGolFilter(src, dst, window, degree, degree);
+        benchmark::DoNotOptimize(dst.data);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(src.total()));
+    state.SetLabel(std::to_string(src.cols) + "x" + std::to_string(src.rows));
+}
+BENCHMARK(BM_SmoothSavGolFilter)
+    ->Apply([](benchmark::internal::Benchmark* b) { configArgs(b, {1, 10, 100}); })
+    ->Unit(benchmark::kMillisecond);
+
+
+/**
+ * Single image with blank region skipping, args: megapixels, window size,
+ * degree. The threshold covers the background noise of the synthetic page.
+ */
+static void BM_SmoothSavGolFilterSkipBlank(benchmark::State& state)
+{
+    const cv::Mat& src = syntheticPage(static_cast<int>(state.range(0)));
+    const cv::Size window(static_cast<int>(state.range(1)), static_cast<int>(state.range(1)));
+    const int degree = static_cast<int>(state.range(2));
+
+    cv::Mat dst;
+    SavGolSkipReport report;
+    for (auto _ : state) {
+        smoothSavGolFilter(src, dst, window, degree, degree, SavGolBlankSkip(16), &report);
+        benchmark::DoNotOptimize(dst.data);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(src.total()));
+    state.counters["skipped"] = report.skippedFraction();
+}
+BENCHMARK(BM_SmoothSavGolFilterSkipBlank)
+    ->Apply([](benchmark::internal::Benchmark* b) { configArgs(b, {1, 10}); })
+    ->Unit(benchmark::kMillisecond);
+
+
+/**
+ * Single image in adaptive mode with the default levels, args: megapixels.
+ * The counters give the fraction of tiles per level.
+ */
+static void BM_SmoothSavGolFilterAdaptive(benchmark::State& state)
+{
+    const cv::Mat& src = syntheticPage(static_cast<int>(state.range(0)));
+
+    const SavGolAdaptive adaptive;
+    std::vector<int64_t> level_tiles;
+    cv::Mat dst;
+    for (auto _ : state) {
+        smoothSavGolFilter(src, dst, adaptive, &level_tiles);
+        benchmark::DoNotOptimize(dst.data);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(src.total()));
+
+    int64_t total = 0;
+    for (int64_t tiles : level_tiles)
+        total += tiles;
+    for (size_t l = 0; l < level_tiles.size(); ++l)
+        state.counters["level" + std::to_string(l)] = static_cast<double>(level_tiles[l]) / total;
+}
+BENCHMARK(BM_SmoothSavGolFilterAdaptive)
+    ->Arg(1)->Arg(10)
+    ->Unit(benchmark::kMillisecond);
+
+
+/**
+ * Kernel setup alone, args: window size, degree.
+ */
+static void BM_SavitzkyGolayPlan(benchmark::State& state)
+{
+    const cv::Size window(static_cast<int>(state.range(0)), static_cast<int>(state.range(0)));
+    const int degree = static_cast<int>(state.range(1));
+
+    for (auto _ : state) {
+        SavitzkyGolayPlan plan(window, degree, degree);
+        benchmark::DoNotOptimize(plan.horKernel(0));
+    }
+}
+BENCHMARK(BM_SavitzkyGolayPlan)
+    ->Args({5, 3})->Args({7, 4})->Args({11, 4})->Args({11, 2})->Args({21, 6})
+    ->Unit(benchmark::kMicrosecond);
+
+
+/**
+ * 2D kernels for every origin of the window, args: window size, degree.
+ */
+static void BM_SavitzkyGolayKernelBank(benchmark::State& state)
+{
+    const int size = static_cast<int>(state.range(0));
+    const int degree = static_cast<int>(state.range(1));
+
+    std::vector<cv::Point> origins;
+    for (int y = 0; y < size; ++y)
+        for (int x = 0; x < size; ++x)
+            origins.push_back(cv::Point(x, y));
+    std::vector<float> bank(origins.size() * size * size);
+
+    for (auto _ : state) {
+        SavitzkyGolayKernel kernel(cv::Size(size, size), cv::Point(0, 0), degree, degree);
+        kernel.kernelBank(origins, bank.data(), size * size);
+        benchmark::DoNotOptimize(bank.data());
+    }
+}
+BENCHMARK(BM_SavitzkyGolayKernelBank)
+    ->Args({5, 3})->Args({11, 4})->Args({21, 6})
+    ->Unit(benchmark::kMillisecond);
+
+
+/**
+ * Batch of 32 pages, args: megapixels per page, window size, degree, threads.
+ */
+static void BM_SmoothSavGolFilterBatch(benchmark::State& state)
+{
+    const std::vector<cv::Mat> pages(32, syntheticPage(static_cast<int>(state.range(0))));
+    const cv::Size window(static_cast<int>(state.range(1)), static_cast<int>(state.range(1)));
+    const int degree = static_cast<int>(state.range(2));
+    WorkStealingPool workers(static_cast<int>(state.range(3)));
+
+    std::vector<cv::Mat> dst;
+    for (auto _ : state) {
+        smoothSavGolFilterBatch(pages, dst, window, degree, degree, workers);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(pages.size() * pages[0].total()));
+}
+BENCHMARK(BM_SmoothSavGolFilterBatch)
+    ->ArgsProduct({{1}, {7}, {4}, {1, 2, 4, 8, 16}})
+    ->ArgsProduct({{10}, {11}, {4}, {1, 4, 16}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+
+int main(int argc, char** argv)
+{
+    //Default to a JSON report so runs can be compared across releases
+    std::vector<char*> args(argv, argv + argc);
+    std::string out_flag = "--benchmark_out=smoothsavgol_bench.json";
+    std::string format_flag = "--benchmark_out_format=json";
+    bool has_out = false;
+    for (int i = 1; i < argc; ++i)
+        has_out = has_out || std::string(argv[i]).compare(0, 16, "--benchmark_out=") == 0;
+    if (!has_out) {
+        args.push_back(&out_flag[0]);
+        args.push_back(&format_flag[0]);
+    }
+
+    int num_args = static_cast<int>(args.size());
+    benchmark::Initialize(&num_args, args.data());
+    if (benchmark::ReportUnrecognizedArguments(num_args, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -1,7 +1,7 @@
 /*
  * This template specifies the alignment of the array
- * in terms of units. This will ultimately weild an optimize
- * SSE code  while we are working with image strides and
+ * in bytes. This will ultimately weild an optimize
+ * SSE/AVX code  while we are working with image strides and
  * performing convolution of 2d Containers.
  *
  * Developed by Anubhav Rohatgi
@@ -15,32 +15,96 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 #define DEFINE_NON_COPYABLE(Class) \
     private: \
-    Class(Class const&); \
-    Class& operator=(Class const&);
+    Class(Class const&) = delete; \
+    Class& operator=(Class const&) = delete;
+
+/**
+ * @brief alignedMalloc Allocates raw storage of at least size bytes
+ *        starting at an address that is a multiple of alignment.
+ *        Throws std::bad_alloc on failure.
+ */
+inline void* alignedMalloc(size_t size, size_t alignment)
+{
+    void* p = nullptr;
+#ifdef _WIN32
+    p = _aligned_malloc(size, alignment);
+#else
+    if (alignment < sizeof(void*))
+        alignment = sizeof(void*);
+    if (posix_memalign(&p, alignment, size) != 0)
+        p = nullptr;
+#endif
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+inline void alignedFree(void* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
 
 /**
  * @brief An array of elements starting at address with a
- *        specified alignment. The alignement is specified
- *        in terms of units where bytes = units * sizeof(T)
+ *        specified alignment. The alignment is specified
+ *        in bytes, so 32/64 byte AVX/AVX-512 alignment can be
+ *        requested for any element type. The storage is padded
+ *        up to a multiple of the alignment, so full vector loads
+ *        of the last elements stay inside the allocation.
+ *
+ *        Trivial types are left uninitialized, other types are
+ *        default constructed in place. The array is movable but
+ *        not copyable.
  */
-template<typename T, size_t align_in_units>
+template<typename T, size_t align_in_bytes>
 class AlignArray
 {
+    static_assert((align_in_bytes & (align_in_bytes - 1)) == 0,
+                  "AlignArray: alignment must be a power of two");
+    static_assert(align_in_bytes >= alignof(T),
+                  "AlignArray: alignment is smaller than the natural alignment of T");
+
     DEFINE_NON_COPYABLE(AlignArray)
 
 public:
+    enum { alignment = align_in_bytes };
+
         /**
          * @brief AlignArray Constructs a null array.
          */
-    AlignArray() : m_pAlignedData(nullptr), m_pStorage(nullptr) { }
+    AlignArray() : m_pAlignedData(nullptr), m_size(0) { }
+
+    explicit AlignArray(size_t size);
+
+    AlignArray(AlignArray&& other) noexcept : m_pAlignedData(other.m_pAlignedData), m_size(other.m_size) {
+        other.m_pAlignedData = nullptr;
+        other.m_size = 0;
+    }
 
-    AlignArray(size_t size);
+    AlignArray& operator=(AlignArray&& other) noexcept {
+        if (this != &other) {
+            AlignArray(std::move(other)).swap(*this);
+        }
+        return *this;
+    }
 
     ~AlignArray() {
-        delete[] m_pStorage;
+        release();
     }
 
     T* data() {
@@ -51,6 +115,14 @@ public:
         return m_pAlignedData;
     }
 
+    size_t size() const {
+        return m_size;
+    }
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
     T& operator[] (size_t index) {
         return m_pAlignedData[index];
     }
@@ -59,42 +131,82 @@ public:
         return m_pAlignedData[index];
     }
 
-    void swap(AlignArray& other);
+    void swap(AlignArray& other) noexcept;
 
 private:
+    void release();
+
     T* m_pAlignedData;
-    T* m_pStorage;
+    size_t m_size;
 };
 
-template<typename T, size_t align_in_units>
-inline void swap(AlignArray<T, align_in_units>& o1,
-                 AlignArray<T, align_in_units>& o2)
+template<typename T, size_t align_in_bytes>
+inline void swap(AlignArray<T, align_in_bytes>& o1,
+                 AlignArray<T, align_in_bytes>& o2) noexcept
 {
     o1.swap(o2);
 }
 
 
 
-template<typename T, size_t align_in_units>
-AlignArray<T, align_in_units>::AlignArray(size_t size)
+template<typename T, size_t align_in_bytes>
+AlignArray<T, align_in_bytes>::AlignArray(size_t size) : m_pAlignedData(nullptr), m_size(0)
 {
-    int const a = (align_in_units > 1) ? align_in_units : 1;
-    int const am1 = a - 1;
-    m_pStorage = new T[size + am1];
-    m_pAlignedData = m_pStorage + ( (a - ((uintptr_t(m_pStorage)/sizeof(T)) & am1)) & am1);
+    if (size == 0)
+        return;
+
+    //The byte count, rounded up, must not wrap around
+    size_t const am1 = align_in_bytes - 1;
+    if (size > (SIZE_MAX - am1) / sizeof(T))
+        throw std::bad_alloc();
+    size_t const bytes = (size * sizeof(T) + am1) & ~am1;
+    T* const p = static_cast<T*>(alignedMalloc(bytes, align_in_bytes));
+
+    if (!std::is_trivially_default_constructible<T>::value) {
+        size_t i = 0;
+        try {
+            for (; i < size; ++i)
+                new (p + i) T();
+        } catch (...) {
+            while (i > 0)
+                p[--i].~T();
+            alignedFree(p);
+            throw;
+        }
+    }
+
+    m_pAlignedData = p;
+    m_size = size;
+}
+
+
+template<typename T, size_t align_in_bytes>
+void AlignArray<T, align_in_bytes>::release()
+{
+    if (!m_pAlignedData)
+        return;
+
+    if (!std::is_trivially_destructible<T>::value) {
+        for (size_t i = m_size; i > 0; --i)
+            m_pAlignedData[i - 1].~T();
+    }
+    alignedFree(m_pAlignedData);
+
+    m_pAlignedData = nullptr;
+    m_size = 0;
 }
 
 
-template<typename T, size_t align_in_units>
-void AlignArray<T, align_in_units>::swap(AlignArray& other)
+template<typename T, size_t align_in_bytes>
+void AlignArray<T, align_in_bytes>::swap(AlignArray& other) noexcept
 {
     T* temp = m_pAlignedData;
     m_pAlignedData = other.m_pAlignedData;
     other.m_pAlignedData = temp;
 
-    temp = m_pStorage;
-    m_pStorage = other.m_pStorage;
-    other.m_pStorage = temp;
+    size_t const temp_size = m_size;
+    m_size = other.m_size;
+    other.m_size = temp_size;
 }
 
 #endif // ALIGNARRAY_H
@@ -0,0 +1,85 @@
+/*
+ * A blocking queue of limited capacity connecting the stages of a
+ * pipeline. Producers wait while it is full, so a fast stage cannot
+ * run arbitrarily far ahead of a slow one.
+ */
+#pragma once
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include "alignarray.h"
+
+
+/**
+ * @brief The BoundedQueue class Multi producer, multi consumer FIFO. Once
+ *          closed, push fails and pop drains the remaining items before
+ *          failing too.
+ */
+template<typename T>
+class BoundedQueue
+{
+    DEFINE_NON_COPYABLE(BoundedQueue)
+
+public:
+    explicit BoundedQueue(size_t capacity) :
+        m_capacity(capacity > 0 ? capacity : 1), m_closed(false) {}
+
+    /**
+     * @brief push Waits for room and appends item. Returns false if the queue
+     *          was closed, item is left untouched then.
+     */
+    bool push(T&& item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+            return false;
+        m_items.push_back(std::move(item));
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief pop Waits for an item. Returns false once the queue is closed
+     *          and empty.
+     */
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty())
+            return false;
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief close Wakes all waiting producers and consumers. Items already
+     *          queued can still be popped.
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed;
+};
+
+#endif // BOUNDEDQUEUE_H
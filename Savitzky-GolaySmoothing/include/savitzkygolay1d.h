@@ -0,0 +1,146 @@
+/*
+ * One dimensional Savitzky Golay smoothing of signals: sensor time
+ * series, projection profiles of scans. A batch filter for whole
+ * arrays and a streaming filter taking one sample at a time.
+ */
+#pragma once
+
+#ifndef SAVITZKYGOLAY1D_H
+#define SAVITZKYGOLAY1D_H
+
+#include <deque>
+#include <vector>
+
+#include "alignarray.h"
+#include "savitzkygolayplan.h"
+
+
+/**
+ * @brief The SavitzkyGolay1D class Smooths signals with a window of samples
+ *          and a polynomial degree. Like the 2D filter the window is pinned
+ *          to the ends of the signal, so the first and last samples are
+ *          evaluated off center instead of being padded. Signals shorter than
+ *          the window are fitted over their whole length.
+ *
+ *          The member templates are instantiated for float and double. The
+ *          kernels are single precision.
+ */
+class SavitzkyGolay1D
+{
+    DEFINE_NON_COPYABLE(SavitzkyGolay1D)
+
+public:
+    /**
+     * @param window Number of samples in the window
+     * @param degree Degree of the polynomial, less than window
+     */
+    SavitzkyGolay1D(int window, int degree);
+
+    int window() const {
+        return m_window;
+    }
+
+    int degree() const {
+        return m_degree;
+    }
+
+    /**
+     * @brief kernel The kernel whose output sample sits at origin in the window.
+     */
+    float const* kernel(int origin) const {
+        return m_plan.horKernel(origin);
+    }
+
+    /**
+     * @brief apply Smooths one contiguous signal. dst may be src.
+     */
+    template<typename T>
+    void apply(T const* src, T* dst, int length) const;
+
+    /**
+     * @brief applyRows Smooths num_signals contiguous signals, signal i
+     *          starting at src + i * stride. dst uses the same layout.
+     */
+    template<typename T>
+    void applyRows(T const* src, T* dst, int length, int num_signals, int stride) const;
+
+    /**
+     * @brief applyInterleaved Smooths num_signals signals stored sample major,
+     *          sample t of signal i at src[t * num_signals + i], e.g. one
+     *          column per signal. Every output sample is computed for all
+     *          signals at once, which vectorizes across the signals. dst must
+     *          not overlap src.
+     */
+    template<typename T>
+    void applyInterleaved(T const* src, T* dst, int length, int num_signals) const;
+
+private:
+    int m_window;
+    int m_degree;
+
+    /**
+     * @brief m_plan Plan of a window x 1 window, its horizontal kernels
+     *      are the kernels for every origin.
+     */
+    SavitzkyGolayPlan m_plan;
+};
+
+
+/**
+ * @brief The SavitzkyGolayStream class Smooths a signal arriving one sample
+ *          at a time, keeping only the last window samples.
+ *
+ *          The output for sample t is ready once sample t + delay arrived.
+ *          delay = 0 is a causal filter evaluating the fit at the newest
+ *          sample, delay = window / 2 the centered filter of the batch mode.
+ *          The first outputs have to wait until window samples arrived and
+ *          become ready together; finish() evaluates the last delay samples
+ *          with the window pinned to the end, like the batch filter.
+ */
+template<typename T>
+class SavitzkyGolayStream
+{
+    DEFINE_NON_COPYABLE(SavitzkyGolayStream)
+
+public:
+    /**
+     * @param delay Samples between input and output, less than window
+     */
+    SavitzkyGolayStream(int window, int degree, int delay);
+
+    void push(T sample);
+
+    /**
+     * @brief pop Takes the next output sample, if one is ready.
+     */
+    bool pop(T& sample);
+
+    /**
+     * @brief finish Marks the end of the signal, the remaining outputs
+     *          become ready.
+     */
+    void finish();
+
+    /**
+     * @brief reset Starts a new signal.
+     */
+    void reset();
+
+private:
+    T evaluate(int origin) const;
+
+    SavitzkyGolay1D m_filter;
+    int m_delay;
+
+    /**
+     * @brief m_history The last window samples, sample n at n % window.
+     */
+    std::vector<T> m_history;
+    long long m_numPushed;
+    long long m_numEmitted;
+    bool m_finished;
+
+    std::deque<T> m_ready;
+};
+
+#endif // SAVITZKYGOLAY1D_H
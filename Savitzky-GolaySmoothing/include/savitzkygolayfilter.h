@@ -11,10 +11,16 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <vector>
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 
 #include "savitzkygolaykernel.h"
+#include "savitzkygolayplan.h"
+#include "savitzkygolaystats.h"
+#include "scratchpool.h"
+#include "tilerangemap.h"
+#include "workstealingpool.h"
 
 
 
@@ -44,6 +50,163 @@
 void smoothSavGolFilter(const cv::Mat& src, cv::Mat& dst, const cv::Size& window_size,
                         const int hor_degree, const int vert_degree);
 
+/**
+ * @brief smoothSavGolFilter Same as above, but draws the temporary buffers
+ *                      from the given pool instead of the thread local one.
+ *                      Kernels are cached per thread, so repeated calls with
+ *                      the same window and degrees into a destination of the
+ *                      same size do not allocate.
+ * @param pool          Pool of scratch buffers owned by the calling thread.
+ * @param stats         If not null, receives the per region timings, pixel counts
+ *                      and kernel setup costs of the call. Only collected when
+ *                      built with SAVGOL_PROFILING, see savitzkygolaystats.h.
+ */
+void smoothSavGolFilter(const cv::Mat& src, cv::Mat& dst, const cv::Size& window_size,
+                        const int hor_degree, const int vert_degree, ScratchPool& pool,
+                        SavGolStats* stats = nullptr);
+
+/**
+ * @brief The SavGolBlankSkip struct Settings of the blank region skipping mode.
+ *          The fit of a constant area is that constant, so tiles whose
+ *          window neighborhood is (nearly) uniform are copied instead of
+ *          filtered. With a threshold of 0 only exactly uniform areas are
+ *          skipped; a small threshold also skips scanner noise on the paper
+ *          background.
+ * @note  Skipped tiles can differ from the filtered result by one gray level
+ *        even at threshold 0: the central passes truncate, and for some gray
+ *        levels and window sizes the float sum over a constant area lands
+ *        just below the constant.
+ */
+struct SavGolBlankSkip
+{
+    /**
+     * @brief threshold Tiles are copied if max - min over the tiles their
+     *          windows read from is at most threshold.
+     */
+    int threshold;
+
+    /**
+     * @brief tile_size Edge length of the tiles in pixels.
+     */
+    int tile_size;
+
+    explicit SavGolBlankSkip(int threshold = 0, int tile_size = 32) :
+        threshold(threshold), tile_size(tile_size) {}
+};
+
+/**
+ * @brief The SavGolSkipReport struct How much of an image was copied by the
+ *          blank region skipping mode instead of filtered.
+ */
+struct SavGolSkipReport
+{
+    int64_t total_tiles;
+    int64_t skipped_tiles;
+    int64_t total_pixels;
+    int64_t skipped_pixels;
+
+    SavGolSkipReport() : total_tiles(0), skipped_tiles(0), total_pixels(0), skipped_pixels(0) {}
+
+    double skippedFraction() const {
+        return total_pixels ? static_cast<double>(skipped_pixels) / total_pixels : 0.0;
+    }
+};
+
+/**
+ * @brief smoothSavGolFilter Same as above, but only filters tiles with content.
+ *                      A min/max map of the source tiles is built first, tiles
+ *                      whose window neighborhood is uniform according to skip
+ *                      are copied from the source and the remaining tiles are
+ *                      filtered in runs along each tile row.
+ * @param skip          Tile size and uniformity threshold.
+ * @param report        If not null, receives the number of tiles and pixels skipped.
+ */
+void smoothSavGolFilter(const cv::Mat& src, cv::Mat& dst, const cv::Size& window_size,
+                        const int hor_degree, const int vert_degree, const SavGolBlankSkip& skip,
+                        SavGolSkipReport* report = nullptr);
+
+/**
+ * @brief The SavGolAdaptiveLevel struct One window and degree configuration
+ *          of the adaptive mode and the tiles it is used for.
+ */
+struct SavGolAdaptiveLevel
+{
+    cv::Size window_size;
+    int hor_degree;
+    int vert_degree;
+
+    /**
+     * @brief max_energy Tiles whose edge energy, the mean of dx^2 + dy^2
+     *          over the tile in gray levels, is at most this take the level.
+     */
+    double max_energy;
+
+    SavGolAdaptiveLevel(cv::Size const& window_size, int hor_degree, int vert_degree, double max_energy) :
+        window_size(window_size), hor_degree(hor_degree), vert_degree(vert_degree),
+        max_energy(max_energy) {}
+};
+
+/**
+ * @brief The SavGolAdaptive struct Settings of the adaptive mode. Flat areas
+ *          such as photos are smoothed with a large window and low degree,
+ *          detailed areas such as fine text with a small one that keeps
+ *          the strokes. The defaults follow the DPI table above: 11x11
+ *          degree 2, 7x7 degree 4 and 5x5 degree 3 for the busiest tiles.
+ */
+struct SavGolAdaptive
+{
+    /**
+     * @brief levels By increasing max_energy. A tile takes the first level
+     *          whose max_energy it does not exceed, the last level if none.
+     */
+    std::vector<SavGolAdaptiveLevel> levels;
+
+    /**
+     * @brief tile_size Edge length of the tiles in pixels.
+     */
+    int tile_size;
+
+    explicit SavGolAdaptive(int tile_size = 32) : tile_size(tile_size) {
+        levels.push_back(SavGolAdaptiveLevel(cv::Size(11, 11), 2, 2, 150.0));
+        levels.push_back(SavGolAdaptiveLevel(cv::Size(7, 7), 4, 4, 1500.0));
+        levels.push_back(SavGolAdaptiveLevel(cv::Size(5, 5), 3, 3, 0.0));
+    }
+};
+
+/**
+ * @brief smoothSavGolFilter Adaptive mode. The edge energy of every tile is
+ *                      measured in one pass, then each tile is filtered with
+ *                      the kernels of its level only, runs of tiles with the
+ *                      same level at once. Every pixel is computed once, the
+ *                      cost is close to a single filter pass. The plans of
+ *                      all levels are cached per thread.
+ * @param adaptive      Levels and tile size.
+ * @param level_tiles   If not null, receives the number of tiles per level.
+ */
+void smoothSavGolFilter(const cv::Mat& src, cv::Mat& dst, const SavGolAdaptive& adaptive,
+                        std::vector<int64_t>* level_tiles = nullptr);
+
+/**
+ * @brief smoothSavGolFilterBatch Smooths a batch of pages with the same window
+ *                      and degrees. The kernels are built once for the whole
+ *                      batch and the pages are spread over the worker pool;
+ *                      small pages are filtered one per worker, large pages
+ *                      are split into bands of rows.
+ * @param src           The source images, 8 bit grayscale single channel.
+ *                      The pages may differ in size.
+ * @param dst           The output images, resized to match src. Existing
+ *                      images of the right size are reused.
+ * @param workers       The pool to run on. The process wide pool is used by
+ *                      the overload without it.
+ * @param stats         If not null, receives the merged timings of all workers.
+ */
+void smoothSavGolFilterBatch(const std::vector<cv::Mat>& src, std::vector<cv::Mat>& dst,
+                             const cv::Size& window_size, const int hor_degree, const int vert_degree);
+
+void smoothSavGolFilterBatch(const std::vector<cv::Mat>& src, std::vector<cv::Mat>& dst,
+                             const cv::Size& window_size, const int hor_degree, const int vert_degree,
+                             WorkStealingPool& workers, SavGolStats* stats = nullptr);
+
 
 
 
@@ -67,22 +230,7 @@ public:
 
 inline void SavitzkyGolayFilter::convolve(uint8_t *dst, const uint8_t *src_top_left, int src_bpl) const
 {
-    const uint8_t* p_src = src_top_left;
-    const float* p_kernel = data();
-    float sum = 0.5; // For rounding purposes.
-
-    const int w = width();
-    const int h = height();
-
-    for (int y = 0; y < h; ++y, p_src += src_bpl) {
-        for (int x = 0; x < w; ++x) {
-            sum += p_src[x] * (*p_kernel);
-            ++p_kernel;
-        }
-    }
-
-    const int val = static_cast<int>(sum);
-    *dst = static_cast<uint8_t>( MAX(0, MIN(val, 255)));
+    convolveKernel(dst, data(), width(), height(), src_top_left, src_bpl);
 }
 
 #endif // SAVITZKYGOLAYFILTER_H
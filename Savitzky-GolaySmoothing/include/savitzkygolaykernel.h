@@ -17,7 +17,10 @@
 #include "alignarray.h"
 /**
  * @brief The SavitzkyGolayKernel class Calculates the Savitzky - Golay Filter
- *          kernel.
+ *          kernel. The least squares fit of the window is the projection
+ *          H = Q1 * Q1^T, Q1 being the orthonormal basis from the QR
+ *          factorization of the equations. The kernel for an origin is the
+ *          origin's row of H, one dot product of basis rows per data point.
  */
 class SavitzkyGolayKernel
 {
@@ -28,6 +31,12 @@ public:
 
     void recalcForOrigin(cv::Point const& origin);
 
+    /**
+     * @brief kernelBank Writes the kernels of all origins, each stride floats
+     *          apart, as one blocked product of the basis rows.
+     */
+    void kernelBank(std::vector<cv::Point> const& origins, float* bank, int stride) const;
+
     int width() const {
         return m_width;
     }
@@ -54,39 +63,25 @@ private:
     };
 
     /**
-     * @brief QR Factorization
-     */
-    void QR();
-
-
-    /**
-     * @brief m_equations A matrix of m_numDataPoints rows and
-     *      m_numVars columns. Stored row wise (rows strides)
-     */
-    std::vector<double> m_equations;
-
-    /**
-     * @brief m_dataPoints number of data points stored row wise
+     * @brief QR Factorization of equations by Givens rotations. The
+     *      rotations are then applied in reverse to the first m_numTerms
+     *      unit vectors, which gives m_basis.
+     * @param equations A matrix of m_numDataPoints rows and m_numTerms
+     *      columns. Stored row wise (rows strides), overwritten by R.
      */
-    std::vector<double> m_dataPoints;
-
-    /**
-     * @brief m_coeffs Polynomial coefficients of size m_numVars.
-     */
-    std::vector<double> m_coeffs;
+    void QR(std::vector<double>& equations);
 
 
     /**
-     * @brief m_rotations The rotations applied to m_equations as part of
-     *      QR factorization. Later on same rotations are applied to copy
-     *      of m_dataPoints.
+     * @brief m_basis Q1, m_numDataPoints rows of m_numTerms orthonormal
+     *      columns. Stored row wise.
      */
-    std::vector<Rotation> m_rotations;
+    std::vector<double> m_basis;
 
     /**
-     * @brief m_kernel A 16-byte convolution kernel of size m_numDataPoints.
+     * @brief m_kernel A 32-byte aligned convolution kernel of size m_numDataPoints.
      */
-    AlignArray<float,4> m_kernel;
+    AlignArray<float,32> m_kernel;
 
 
     /**
@@ -129,5 +124,32 @@ inline int calcNumTerms(int const hor_degree, int const vert_degree)
     return (hor_degree + 1) * (vert_degree + 1);
 }
 
+/**
+ * @brief convolveKernel Applies a kernel stored row wise to the image area
+ *          starting at src_top_left and writes the rounded, saturated result.
+ * @param dst Destination pixel
+ * @param kernel Kernel data of width * height floats
+ * @param width Kernel width
+ * @param height Kernel height
+ * @param src_top_left Pointer to the sources top left corner data point (begin)
+ * @param src_bpl source bytes per line
+ */
+inline void convolveKernel(uint8_t* dst, float const* kernel, int const width, int const height,
+                           uint8_t const* src_top_left, int const src_bpl)
+{
+    const uint8_t* p_src = src_top_left;
+    float sum = 0.5; // For rounding purposes.
+
+    for (int y = 0; y < height; ++y, p_src += src_bpl) {
+        for (int x = 0; x < width; ++x) {
+            sum += p_src[x] * (*kernel);
+            ++kernel;
+        }
+    }
+
+    const int val = static_cast<int>(sum);
+    *dst = static_cast<uint8_t>( MAX(0, MIN(val, 255)));
+}
+
 
 #endif // SAVITZKYGOLAYKERNEL_H
@@ -0,0 +1,110 @@
+/*
+ * Headless read - filter - write pipeline smoothing every image of
+ * a directory. Decoding, filtering and encoding run on their own
+ * threads connected by bounded queues, so the cores keep filtering
+ * while other pages are read from or written to disk.
+ */
+#pragma once
+
+#ifndef SAVITZKYGOLAYPIPELINE_H
+#define SAVITZKYGOLAYPIPELINE_H
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+
+/**
+ * @brief The SavGolPipelineConfig struct Filter settings and the number of
+ *          threads per stage.
+ */
+struct SavGolPipelineConfig
+{
+    cv::Size window_size;
+    int hor_degree;
+    int vert_degree;
+
+    /**
+     * @brief skip_threshold Blank region skipping threshold, see
+     *          SavGolBlankSkip. Negative filters every pixel.
+     */
+    int skip_threshold;
+
+    int num_readers;
+
+    /**
+     * @brief num_filters Filter threads, 0 uses the number of hardware threads.
+     */
+    int num_filters;
+
+    int num_writers;
+
+    /**
+     * @brief queue_depth Images each queue holds before its producers wait.
+     */
+    int queue_depth;
+
+    SavGolPipelineConfig() :
+        window_size(7, 7), hor_degree(4), vert_degree(4), skip_threshold(-1),
+        num_readers(2), num_filters(0), num_writers(2), queue_depth(4) {}
+};
+
+
+/**
+ * @brief The SavGolStageStats struct Work done by all threads of one stage.
+ *          busy_seconds is the time spent in imread, the filter or imwrite,
+ *          summed over the threads of the stage.
+ */
+struct SavGolStageStats
+{
+    int64_t images;
+    int64_t pixels;
+    int64_t failures;
+    double busy_seconds;
+
+    SavGolStageStats() : images(0), pixels(0), failures(0), busy_seconds(0.0) {}
+
+    void merge(SavGolStageStats const& other);
+};
+
+
+/**
+ * @brief The SavGolPipelineReport struct Per stage throughput of a run.
+ */
+struct SavGolPipelineReport
+{
+    SavGolStageStats read;
+    SavGolStageStats filter;
+    SavGolStageStats write;
+    double wall_seconds;
+
+    SavGolPipelineReport() : wall_seconds(0.0) {}
+
+    /**
+     * @brief print Writes images/s and megapixels/s per stage, both over the
+     *          wall time and over the busy time of the stage.
+     */
+    void print(std::ostream& os) const;
+};
+
+
+/**
+ * @brief listImages Expands a directory or a glob pattern such as
+ *          "scans/page*.tif" into a sorted list of image files. Directories
+ *          are searched for common image extensions, not recursively.
+ */
+std::vector<std::string> listImages(std::string const& dir_or_pattern);
+
+/**
+ * @brief runSavGolPipeline Smooths every input and writes the result under
+ *          the same file name into output_dir, which must exist. Images that
+ *          fail to load, filter or save are reported on std::cerr, counted
+ *          in the stage failures and skipped.
+ */
+SavGolPipelineReport runSavGolPipeline(std::vector<std::string> const& inputs,
+                                       std::string const& output_dir,
+                                       SavGolPipelineConfig const& config);
+
+#endif // SAVITZKYGOLAYPIPELINE_H
@@ -0,0 +1,103 @@
+/*
+ * Precomputed Savitzky Golay kernels for one window and degree
+ * configuration. A plan is immutable once built and can be shared
+ * between threads filtering different images or bands.
+ */
+#pragma once
+
+#ifndef SAVITZKYGOLAYPLAN_H
+#define SAVITZKYGOLAYPLAN_H
+
+#include <opencv2/core.hpp>
+
+#include "alignarray.h"
+#include "savitzkygolaykernel.h"
+#include "savitzkygolaystats.h"
+#include "scratchpool.h"
+
+
+/**
+ * @brief The SavitzkyGolayPlan class Holds the 1D kernels for every origin
+ *          inside the window. The polynomial basis is a tensor product, so
+ *          the 2D kernel for origin (x, y) is the outer product of the
+ *          vertical kernel for y and the horizontal kernel for x. Every
+ *          region, the borders included, is filtered in two 1D passes.
+ */
+class SavitzkyGolayPlan
+{
+    DEFINE_NON_COPYABLE(SavitzkyGolayPlan)
+
+public:
+    SavitzkyGolayPlan(cv::Size const& window_size, int hor_degree, int vert_degree);
+
+    cv::Size const& windowSize() const {
+        return m_windowSize;
+    }
+
+    int horDegree() const {
+        return m_horDegree;
+    }
+
+    int vertDegree() const {
+        return m_vertDegree;
+    }
+
+    /**
+     * @brief horKernel The horizontal kernel of window width whose output
+     *          sample sits at column origin_x of the window.
+     */
+    float const* horKernel(int origin_x) const {
+        return m_horKernels.data() + origin_x * m_horStride;
+    }
+
+    /**
+     * @brief vertKernel The vertical kernel of window height whose output
+     *          sample sits at row origin_y of the window.
+     */
+    float const* vertKernel(int origin_y) const {
+        return m_vertKernels.data() + origin_y * m_vertStride;
+    }
+
+    /**
+     * @brief apply Filters the pixels of src inside region into the same
+     *          pixels of dst. The whole source stays accessible, so tiles or
+     *          bands of one image can be filtered independently and
+     *          concurrently.
+     * @param src       8 bit grayscale image, at least as big as the window
+     * @param dst       Preallocated 8 bit destination of the same size as src.
+     *                  It must not share memory with src.
+     * @param region    Output pixels to compute, inside the image
+     * @param pool      Scratch pool of the calling thread
+     */
+    void apply(cv::Mat const& src, cv::Mat& dst,
+               cv::Rect const& region, ScratchPool& pool) const;
+
+    /**
+     * @brief apply Filters the rows [row_begin, row_end) of src.
+     */
+    void apply(cv::Mat const& src, cv::Mat& dst,
+               int row_begin, int row_end, ScratchPool& pool) const {
+        apply(src, dst, cv::Rect(0, row_begin, src.cols, row_end - row_begin), pool);
+    }
+
+private:
+    cv::Size m_windowSize;
+    int m_horDegree;
+    int m_vertDegree;
+
+    /**
+     * @brief m_horStride  Floats between consecutive kernels, padded
+     * @brief m_vertStride so every kernel starts 32-byte aligned.
+     */
+    int m_horStride;
+    int m_vertStride;
+
+    /**
+     * @brief m_horKernels  One kernel per origin inside the window.
+     * @brief m_vertKernels
+     */
+    AlignArray<float, 32> m_horKernels;
+    AlignArray<float, 32> m_vertKernels;
+};
+
+#endif // SAVITZKYGOLAYPLAN_H
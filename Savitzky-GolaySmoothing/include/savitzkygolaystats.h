@@ -0,0 +1,161 @@
+/*
+ * Optional instrumentation of the Savitzky Golay filter. Timings are
+ * only collected when the project is built with SAVGOL_PROFILING
+ * defined, otherwise the probes compile to nothing.
+ */
+#pragma once
+
+#ifndef SAVITZKYGOLAYSTATS_H
+#define SAVITZKYGOLAYSTATS_H
+
+#include <stdint.h>
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+
+/**
+ * @brief The SavGolSection enum The nine image regions of smoothSavGolFilter
+ *          followed by the kernel setup steps. Plan setup includes the QR
+ *          factorization and the kernel recalculations.
+ */
+enum SavGolSection {
+    SAVGOL_TOP_LEFT = 0,
+    SAVGOL_TOP,
+    SAVGOL_TOP_RIGHT,
+    SAVGOL_LEFT,
+    SAVGOL_CENTER,
+    SAVGOL_RIGHT,
+    SAVGOL_BOTTOM_LEFT,
+    SAVGOL_BOTTOM,
+    SAVGOL_BOTTOM_RIGHT,
+    SAVGOL_PLAN_SETUP,
+    SAVGOL_QR,
+    SAVGOL_RECALC_FOR_ORIGIN,
+    SAVGOL_NUM_SECTIONS
+};
+
+/**
+ * @brief savGolSectionName Printable name of a section.
+ */
+const char* savGolSectionName(SavGolSection section);
+
+
+/**
+ * @brief The SavGolStats struct Accumulated timings of one or more filter
+ *          calls, filled in when the caller passes it to smoothSavGolFilter.
+ */
+struct SavGolStats
+{
+    struct Section {
+        int64_t nanoseconds;
+        int64_t pixels;
+        int64_t calls;
+    };
+
+    /**
+     * @brief The TraceEvent struct One timed span, kept for the trace export.
+     */
+    struct TraceEvent {
+        SavGolSection section;
+        int thread;
+        int64_t start_ns;
+        int64_t duration_ns;
+        int64_t pixels;
+    };
+
+    Section sections[SAVGOL_NUM_SECTIONS];
+    std::vector<TraceEvent> events;
+
+    SavGolStats() {
+        reset();
+    }
+
+    void reset();
+
+    /**
+     * @brief merge Adds the sections and events of other.
+     */
+    void merge(SavGolStats const& other);
+
+    Section const& operator[](SavGolSection section) const {
+        return sections[section];
+    }
+
+    /**
+     * @brief numKernelRecalcs The number of single kernels or kernel banks
+     *          computed from the projection.
+     */
+    int64_t numKernelRecalcs() const {
+        return sections[SAVGOL_RECALC_FOR_ORIGIN].calls;
+    }
+
+    /**
+     * @brief filterNanoseconds Time spent in the nine image regions.
+     */
+    int64_t filterNanoseconds() const;
+};
+
+/**
+ * @brief writeChromeTrace Writes the events in the Chrome trace event format,
+ *          to be loaded in chrome://tracing or Perfetto.
+ */
+void writeChromeTrace(std::ostream& os, SavGolStats const& stats);
+
+
+/**
+ * @brief The SavGolStatsScope class Directs the probes of the calling thread
+ *          into stats for the lifetime of the scope. Scopes nest.
+ */
+class SavGolStatsScope
+{
+public:
+    explicit SavGolStatsScope(SavGolStats* stats);
+    ~SavGolStatsScope();
+
+    /**
+     * @brief current The stats the calling thread records into, or null.
+     */
+    static SavGolStats* current();
+
+private:
+    SavGolStatsScope(SavGolStatsScope const&) = delete;
+    SavGolStatsScope& operator=(SavGolStatsScope const&) = delete;
+
+    SavGolStats* m_pPrevious;
+};
+
+
+/**
+ * @brief The SavGolScopedTimer class Adds the lifetime of the timer to a
+ *          section of the current stats, if any.
+ */
+class SavGolScopedTimer
+{
+public:
+    SavGolScopedTimer(SavGolSection section, int64_t pixels) :
+        m_pStats(SavGolStatsScope::current()), m_section(section), m_pixels(pixels) {
+        if (m_pStats)
+            m_start = std::chrono::steady_clock::now();
+    }
+
+    ~SavGolScopedTimer();
+
+private:
+    SavGolScopedTimer(SavGolScopedTimer const&) = delete;
+    SavGolScopedTimer& operator=(SavGolScopedTimer const&) = delete;
+
+    SavGolStats* m_pStats;
+    SavGolSection m_section;
+    int64_t m_pixels;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+
+#ifdef SAVGOL_PROFILING
+#define SAVGOL_PROFILE(section, pixels) SavGolScopedTimer savgol_scoped_timer((section), (pixels))
+#else
+#define SAVGOL_PROFILE(section, pixels) ((void)(section), (void)(pixels))
+#endif
+
+#endif // SAVITZKYGOLAYSTATS_H
@@ -0,0 +1,122 @@
+/*
+ * Savitzky Golay smoothing of image stacks (CT or microscopy z-stacks)
+ * with a 3D polynomial fit. Slices are streamed through, only as many
+ * slices as the depth window are kept in memory.
+ */
+#pragma once
+
+#ifndef SAVITZKYGOLAYVOLUME_H
+#define SAVITZKYGOLAYVOLUME_H
+
+#include <deque>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "alignarray.h"
+#include "savitzkygolayplan.h"
+
+
+/**
+ * @brief The SavitzkyGolayVolumeFilter class Smooths a stack slice by slice.
+ *          The basis is the tensor product of the horizontal, vertical and
+ *          depth polynomials, so the 3D kernel factors into three 1D kernels
+ *          and is evaluated in three passes. Every incoming slice is filtered
+ *          in the plane into a ring of depth_window float planes; the depth
+ *          pass combines the ring into output slices. Windows are pinned to
+ *          the volume borders like in smoothSavGolFilter.
+ *
+ *          Output slice z is ready once slice z + depth_window / 2 was pushed,
+ *          the last ones once finish() is called:
+ * \code
+ *          SavitzkyGolayVolumeFilter filter(cv::Size(7, 7), 5, 4, 4, 2);
+ *          cv::Mat out;
+ *          for (...) {
+ *              filter.push(slice);
+ *              while (filter.pop(out))
+ *                  write(out);
+ *          }
+ *          filter.finish();
+ *          while (filter.pop(out))
+ *              write(out);
+ * \endcode
+ */
+class SavitzkyGolayVolumeFilter
+{
+    DEFINE_NON_COPYABLE(SavitzkyGolayVolumeFilter)
+
+public:
+    /**
+     * @param window_size  In plane aperture
+     * @param depth_window Number of slices in the aperture
+     * @param hor_degree   Degree of the polynomial in horizontal direction,
+     *                     less than the window width. Likewise vert_degree
+     *                     and depth_degree.
+     */
+    SavitzkyGolayVolumeFilter(cv::Size const& window_size, int depth_window,
+                              int hor_degree, int vert_degree, int depth_degree);
+
+    /**
+     * @brief push Adds the next slice, 8 bit grayscale. All slices must have
+     *          the same size, at least as big as the window.
+     */
+    void push(cv::Mat const& slice);
+
+    /**
+     * @brief finish Marks the end of the stack, the remaining output slices
+     *          become ready. The stack must have at least depth_window slices.
+     */
+    void finish();
+
+    /**
+     * @brief pop Takes the next output slice in stack order, if one is ready.
+     */
+    bool pop(cv::Mat& slice);
+
+    /**
+     * @brief reset Starts a new stack.
+     */
+    void reset();
+
+private:
+    void filterPlane(cv::Mat const& slice, float* out) const;
+    void emit(int z, int window_z);
+
+    int m_depthWindow;
+
+    SavitzkyGolayPlan m_plane;
+
+    /**
+     * @brief m_depth The horizontal kernels of a depth_window x 1 plan are
+     *      the depth kernels.
+     */
+    SavitzkyGolayPlan m_depth;
+
+    cv::Size m_sliceSize;
+
+    /**
+     * @brief m_planeStride Floats per plane, padded to 8.
+     */
+    int m_planeStride;
+
+    /**
+     * @brief m_ring The last depth_window slices filtered in the plane,
+     *      slice n stored at n % depth_window.
+     */
+    AlignArray<float, 32> m_ring;
+
+    int m_numPushed;
+    int m_numEmitted;
+    bool m_finished;
+
+    std::deque<cv::Mat> m_ready;
+};
+
+
+/**
+ * @brief smoothSavGolFilter3D Smooths a whole stack, see SavitzkyGolayVolumeFilter.
+ */
+void smoothSavGolFilter3D(std::vector<cv::Mat> const& src, std::vector<cv::Mat>& dst,
+                          cv::Size const& window_size, int depth_window,
+                          int hor_degree, int vert_degree, int depth_degree);
+
+#endif // SAVITZKYGOLAYVOLUME_H
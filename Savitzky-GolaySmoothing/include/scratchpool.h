@@ -0,0 +1,172 @@
+/*
+ * A pool of reusable aligned scratch buffers. Filters draw their
+ * temporary storage from the pool and hand it back when done, so
+ * repeated filtering of same sized images does not touch the heap.
+ */
+#pragma once
+
+#ifndef SCRATCHPOOL_H
+#define SCRATCHPOOL_H
+
+#include <vector>
+#include <type_traits>
+
+#include "alignarray.h"
+
+class ScratchPool;
+
+/**
+ * @brief The ScratchBuffer class A typed lease on a block of the pool.
+ *          The block is returned to the pool when the buffer goes
+ *          out of scope. The contents are uninitialized.
+ */
+template<typename T>
+class ScratchBuffer
+{
+    DEFINE_NON_COPYABLE(ScratchBuffer)
+
+public:
+    ScratchBuffer() : m_pPool(nullptr), m_size(0) {}
+
+    ScratchBuffer(ScratchBuffer&& other) :
+        m_pPool(other.m_pPool), m_block(std::move(other.m_block)), m_size(other.m_size) {
+        other.m_pPool = nullptr;
+        other.m_size = 0;
+    }
+
+    ScratchBuffer& operator=(ScratchBuffer&& other);
+
+    ~ScratchBuffer() {
+        reset();
+    }
+
+    T* data() {
+        return reinterpret_cast<T*>(m_block.data());
+    }
+
+    T const* data() const {
+        return reinterpret_cast<T const*>(m_block.data());
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    T& operator[] (size_t index) {
+        return data()[index];
+    }
+
+    T const& operator[] (size_t index) const {
+        return data()[index];
+    }
+
+    /**
+     * @brief reset Returns the block to its pool.
+     */
+    void reset();
+
+private:
+    friend class ScratchPool;
+
+    typedef AlignArray<unsigned char, 64> Block;
+
+    ScratchBuffer(ScratchPool* pool, Block&& block, size_t size) :
+        m_pPool(pool), m_block(std::move(block)), m_size(size) {}
+
+    ScratchPool* m_pPool;
+    Block m_block;
+    size_t m_size;
+};
+
+
+/**
+ * @brief The ScratchPool class Keeps 64-byte aligned blocks sorted
+ *          by power of two size classes. A pool is not thread safe,
+ *          use one pool per thread; local() hands out a thread local
+ *          instance.
+ */
+class ScratchPool
+{
+    DEFINE_NON_COPYABLE(ScratchPool)
+
+public:
+    typedef AlignArray<unsigned char, 64> Block;
+
+    ScratchPool() : m_numAllocations(0) {}
+
+    /**
+     * @brief acquire Leases a buffer of at least count elements.
+     */
+    template<typename T>
+    ScratchBuffer<T> acquire(size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "ScratchPool: only trivial element types are supported");
+        static_assert(alignof(T) <= Block::alignment,
+                      "ScratchPool: element alignment is too big");
+        return ScratchBuffer<T>(this, take(count * sizeof(T)), count);
+    }
+
+    /**
+     * @brief trim Frees all blocks currently held by the pool.
+     */
+    void trim();
+
+    /**
+     * @brief cachedBytes The number of bytes held by idle blocks.
+     */
+    size_t cachedBytes() const;
+
+    /**
+     * @brief numAllocations The number of heap allocations performed
+     *          by the pool so far. Stays constant in steady state.
+     */
+    size_t numAllocations() const {
+        return m_numAllocations;
+    }
+
+    /**
+     * @brief local The pool of the calling thread.
+     */
+    static ScratchPool& local();
+
+private:
+    template<typename T> friend class ScratchBuffer;
+
+    Block take(size_t bytes);
+
+    void giveBack(Block&& block);
+
+    /**
+     * @brief m_freeBlocks Idle blocks, indexed by size class. Class i
+     *      holds blocks of (256 << i) bytes.
+     */
+    std::vector<std::vector<Block> > m_freeBlocks;
+
+    size_t m_numAllocations;
+};
+
+
+template<typename T>
+ScratchBuffer<T>& ScratchBuffer<T>::operator=(ScratchBuffer&& other)
+{
+    if (this != &other) {
+        reset();
+        m_pPool = other.m_pPool;
+        m_block = std::move(other.m_block);
+        m_size = other.m_size;
+        other.m_pPool = nullptr;
+        other.m_size = 0;
+    }
+    return *this;
+}
+
+template<typename T>
+void ScratchBuffer<T>::reset()
+{
+    if (m_pPool && !m_block.empty())
+        m_pPool->giveBack(std::move(m_block));
+    m_pPool = nullptr;
+    m_size = 0;
+}
+
+#endif // SCRATCHPOOL_H
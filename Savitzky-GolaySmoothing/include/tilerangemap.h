@@ -0,0 +1,68 @@
+/*
+ * Per tile minimum and maximum of an 8 bit image, used to find
+ * uniform areas (e.g. the paper background of a scan) cheaply.
+ */
+#pragma once
+
+#ifndef TILERANGEMAP_H
+#define TILERANGEMAP_H
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core.hpp>
+
+
+/**
+ * @brief The TileRangeMap class Splits the image into square tiles and keeps
+ *          the smallest and largest value of each. Tiles at the right and
+ *          bottom edges may be smaller.
+ */
+class TileRangeMap
+{
+public:
+    /**
+     * @param image     8 bit grayscale image
+     * @param tile_size Edge length of the tiles in pixels
+     */
+    TileRangeMap(cv::Mat const& image, int tile_size);
+
+    int tileSize() const {
+        return m_tileSize;
+    }
+
+    int cols() const {
+        return m_cols;
+    }
+
+    int rows() const {
+        return m_rows;
+    }
+
+    /**
+     * @brief tileRect The pixels covered by tile (tx, ty).
+     */
+    cv::Rect tileRect(int tx, int ty) const;
+
+    /**
+     * @brief neighborhoodRange Largest maximum minus smallest minimum over the
+     *          tiles at most radius_x columns and radius_y rows of tiles away
+     *          from (tx, ty), the tile itself included.
+     */
+    int neighborhoodRange(int tx, int ty, int radius_x, int radius_y) const;
+
+private:
+    int m_tileSize;
+    int m_width;
+    int m_height;
+    int m_cols;
+    int m_rows;
+
+    /**
+     * @brief m_min Per tile minimum and maximum, stored row wise.
+     * @brief m_max
+     */
+    std::vector<uint8_t> m_min;
+    std::vector<uint8_t> m_max;
+};
+
+#endif // TILERANGEMAP_H
@@ -0,0 +1,90 @@
+/*
+ * A small work stealing thread pool used to spread batches of
+ * images and image bands over the available cores.
+ */
+#pragma once
+
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "alignarray.h"
+
+
+/**
+ * @brief The WorkStealingPool class Runs a set of independent tasks on
+ *          persistent worker threads. Each worker owns a deque, takes
+ *          its own tasks from the back and steals from the front of the
+ *          other deques once its own runs dry. The thread calling run()
+ *          takes part as worker 0.
+ */
+class WorkStealingPool
+{
+    DEFINE_NON_COPYABLE(WorkStealingPool)
+
+public:
+    typedef std::function<void()> Task;
+
+    /**
+     * @brief WorkStealingPool Creates the pool.
+     * @param num_threads Total number of workers including the calling
+     *          thread. 0 uses the number of hardware threads.
+     */
+    explicit WorkStealingPool(int num_threads = 0);
+
+    ~WorkStealingPool();
+
+    int numThreads() const {
+        return static_cast<int>(m_queues.size());
+    }
+
+    /**
+     * @brief run Executes all tasks and blocks until they are finished.
+     *          The first exception thrown by a task is rethrown here once
+     *          the remaining tasks completed.
+     */
+    void run(std::vector<Task>& tasks);
+
+    /**
+     * @brief global A process wide pool with one worker per hardware thread.
+     */
+    static WorkStealingPool& global();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(int index);
+
+    bool popOrSteal(int index, Task& task);
+
+    void execute(Task& task);
+
+    std::vector<std::unique_ptr<Queue> > m_queues;
+    std::vector<std::thread> m_threads;
+
+    //Serializes concurrent calls to run()
+    std::mutex m_runMutex;
+
+    std::mutex m_stateMutex;
+    std::condition_variable m_wakeWorkers;
+    std::condition_variable m_batchDone;
+    unsigned m_generation;
+    bool m_stop;
+
+    std::atomic<size_t> m_pending;
+    std::exception_ptr m_error;
+};
+
+#endif // WORKSTEALINGPOOL_H
@@ -0,0 +1,64 @@
+/*
+ * Headless batch smoothing of a directory of scans.
+ *
+ * usage: smoothsavgol_batch <input dir or pattern> <output dir>
+ *            [--window N] [--degree N] [--skip T]
+ *            [--readers N] [--filters N] [--writers N] [--queue N]
+ */
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "savitzkygolaypipeline.h"
+
+
+static int usage()
+{
+    std::cout << "usage: smoothsavgol_batch <input dir or pattern> <output dir>\n"
+                 "           [--window N] [--degree N] [--skip T]\n"
+                 "           [--readers N] [--filters N] [--writers N] [--queue N]\n";
+    return -1;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return usage();
+
+    SavGolPipelineConfig config;
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc)
+            return usage();
+
+        const int value = atoi(argv[i + 1]);
+        if (!strcmp(argv[i], "--window"))
+            config.window_size = cv::Size(value, value);
+        else if (!strcmp(argv[i], "--degree"))
+            config.hor_degree = config.vert_degree = value;
+        else if (!strcmp(argv[i], "--skip"))
+            config.skip_threshold = value;
+        else if (!strcmp(argv[i], "--readers"))
+            config.num_readers = value;
+        else if (!strcmp(argv[i], "--filters"))
+            config.num_filters = value;
+        else if (!strcmp(argv[i], "--writers"))
+            config.num_writers = value;
+        else if (!strcmp(argv[i], "--queue"))
+            config.queue_depth = value;
+        else
+            return usage();
+    }
+
+    const std::vector<std::string> inputs = listImages(argv[1]);
+    if (inputs.empty()) {
+        std::cout << "\nNo images found in " << argv[1] << "\n";
+        return -1;
+    }
+
+    const SavGolPipelineReport report = runSavGolPipeline(inputs, argv[2], config);
+    report.print(std::cout);
+
+    const int64_t failures = report.read.failures + report.filter.failures + report.write.failures;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * One dimensional Savitzky Golay smoothing of signals.
+ */
+#include "savitzkygolay1d.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+#include "scratchpool.h"
+
+
+namespace {
+
+int checkWindow(int window, int degree)
+{
+    if (window < 1 || degree < 0 || degree >= window)
+        throw std::invalid_argument("SavitzkyGolay1D: invalid window or degree!");
+    return window;
+}
+
+/**
+ * @brief applyShort Fits a signal shorter than the window over its whole
+ *          length. Up to degree + 1 samples the fit goes through every
+ *          sample, so the signal is copied.
+ */
+template<typename T>
+void applyShort(T const* src, T* dst, int length, int stride, int degree, int num_signals, int signal_step)
+{
+    if (length <= degree + 1) {
+        for (int i = 0; i < num_signals; ++i)
+            for (int t = 0; t < length; ++t)
+                dst[i * signal_step + t * stride] = src[i * signal_step + t * stride];
+        return;
+    }
+
+    SavitzkyGolayPlan plan(cv::Size(length, 1), degree, 0);
+
+    std::vector<T> out(length);
+    for (int i = 0; i < num_signals; ++i) {
+        T const* const signal = src + i * signal_step;
+        for (int t = 0; t < length; ++t) {
+            float const* const kernel = plan.horKernel(t);
+            T sum = 0;
+            for (int j = 0; j < length; ++j)
+                sum += signal[j * stride] * kernel[j];
+            out[t] = sum;
+        }
+        for (int t = 0; t < length; ++t)
+            dst[i * signal_step + t * stride] = out[t];
+    }
+}
+
+}
+
+
+SavitzkyGolay1D::SavitzkyGolay1D(int window, int degree) :
+    m_window(checkWindow(window, degree)),
+    m_degree(degree),
+    m_plan(cv::Size(window, 1), degree, 0)
+{
+}
+
+
+template<typename T>
+void SavitzkyGolay1D::apply(T const* src, T* dst, int length) const
+{
+    const int n = m_window;
+    if (length < n) {
+        applyShort(src, dst, length, 1, m_degree, 1, 0);
+        return;
+    }
+
+    const int k_left = n / 2;
+    const int k_right = n - k_left - 1;
+    const int last = length - n;
+    const int center = length - k_left - k_right;
+
+    //Every output reads up to window samples back, so the results are
+    //collected before any of dst is written
+    ScratchBuffer<T> temp = ScratchPool::local().acquire<T>(length);
+    T* const out = temp.data();
+
+    // Start: window pinned to the first samples.
+    for (int t = 0; t < k_left; ++t) {
+        float const* const kernel = this->kernel(t);
+        T sum = 0;
+        for (int j = 0; j < n; ++j)
+            sum += src[j] * kernel[j];
+        out[t] = sum;
+    }
+
+    // Center: one kernel tap for all samples at a time.
+    {
+        T* const out_center = out + k_left;
+        float const* const kernel = this->kernel(k_left);
+        for (int t = 0; t < center; ++t)
+            out_center[t] = 0;
+        for (int j = 0; j < n; ++j) {
+            const T weight = kernel[j];
+            T const* const in = src + j;
+            for (int t = 0; t < center; ++t)
+                out_center[t] += in[t] * weight;
+        }
+    }
+
+    // End: window pinned to the last samples.
+    for (int t = length - k_right; t < length; ++t) {
+        float const* const kernel = this->kernel(t - last);
+        T sum = 0;
+        for (int j = 0; j < n; ++j)
+            sum += src[last + j] * kernel[j];
+        out[t] = sum;
+    }
+
+    memcpy(dst, out, sizeof(T) * length);
+}
+
+
+template<typename T>
+void SavitzkyGolay1D::applyRows(T const* src, T* dst, int length, int num_signals, int stride) const
+{
+    for (int i = 0; i < num_signals; ++i)
+        apply(src + static_cast<size_t>(i) * stride, dst + static_cast<size_t>(i) * stride, length);
+}
+
+
+template<typename T>
+void SavitzkyGolay1D::applyInterleaved(T const* src, T* dst, int length, int num_signals) const
+{
+    if (src == dst)
+        throw std::invalid_argument("SavitzkyGolay1D: applyInterleaved cannot filter in place!");
+
+    const int n = m_window;
+    if (length < n) {
+        applyShort(src, dst, length, num_signals, m_degree, num_signals, 1);
+        return;
+    }
+
+    const int k_left = n / 2;
+    const int last = length - n;
+
+    for (int t = 0; t < length; ++t) {
+        const int window_t = std::min(std::max(t - k_left, 0), last);
+        float const* const kernel = this->kernel(t - window_t);
+
+        T* const out = dst + static_cast<size_t>(t) * num_signals;
+        for (int i = 0; i < num_signals; ++i)
+            out[i] = 0;
+
+        for (int j = 0; j < n; ++j) {
+            const T weight = kernel[j];
+            T const* const in = src + static_cast<size_t>(window_t + j) * num_signals;
+            for (int i = 0; i < num_signals; ++i)
+                out[i] += in[i] * weight;
+        }
+    }
+}
+
+
+template<typename T>
+SavitzkyGolayStream<T>::SavitzkyGolayStream(int window, int degree, int delay) :
+    m_filter(window, degree),
+    m_delay(delay),
+    m_history(window),
+    m_numPushed(0),
+    m_numEmitted(0),
+    m_finished(false)
+{
+    if (delay < 0 || delay >= window)
+        throw std::invalid_argument("SavitzkyGolayStream: invalid delay!");
+}
+
+
+template<typename T>
+void SavitzkyGolayStream<T>::reset()
+{
+    m_numPushed = 0;
+    m_numEmitted = 0;
+    m_finished = false;
+    m_ready.clear();
+}
+
+
+template<typename T>
+T SavitzkyGolayStream<T>::evaluate(int origin) const
+{
+    //The window holds the last window samples, the oldest first
+    const int n = m_filter.window();
+    const long long first = m_numPushed - n;
+    float const* const kernel = m_filter.kernel(origin);
+
+    T sum = 0;
+    for (int j = 0; j < n; ++j)
+        sum += m_history[(first + j) % n] * kernel[j];
+    return sum;
+}
+
+
+template<typename T>
+void SavitzkyGolayStream<T>::push(T sample)
+{
+    if (m_finished)
+        throw std::invalid_argument("SavitzkyGolayStream: push after finish!");
+
+    const int n = m_filter.window();
+    m_history[m_numPushed % n] = sample;
+    ++m_numPushed;
+
+    if (m_numPushed < n)
+        return;
+
+    //Output t sits at origin t - (m_numPushed - n) of the current window.
+    //The first full window also serves the samples before its origin.
+    const long long newest = m_numPushed - 1 - m_delay;
+    for (long long t = m_numEmitted; t <= newest; ++t) {
+        m_ready.push_back(evaluate(static_cast<int>(t - (m_numPushed - n))));
+        ++m_numEmitted;
+    }
+}
+
+
+template<typename T>
+void SavitzkyGolayStream<T>::finish()
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+
+    const int n = m_filter.window();
+    if (m_numPushed < n) {
+        //Too short for the window, fit the whole signal
+        const int length = static_cast<int>(m_numPushed);
+        std::vector<T> out(length);
+        applyShort(m_history.data(), out.data(), length, 1, m_filter.degree(), 1, 0);
+        for (int t = 0; t < length; ++t)
+            m_ready.push_back(out[t]);
+        m_numEmitted = m_numPushed;
+        return;
+    }
+
+    //The window stays pinned to the last samples
+    for (long long t = m_numEmitted; t < m_numPushed; ++t) {
+        m_ready.push_back(evaluate(static_cast<int>(t - (m_numPushed - n))));
+        ++m_numEmitted;
+    }
+}
+
+
+template<typename T>
+bool SavitzkyGolayStream<T>::pop(T& sample)
+{
+    if (m_ready.empty())
+        return false;
+
+    sample = m_ready.front();
+    m_ready.pop_front();
+    return true;
+}
+
+
+template void SavitzkyGolay1D::apply<float>(float const*, float*, int) const;
+template void SavitzkyGolay1D::apply<double>(double const*, double*, int) const;
+template void SavitzkyGolay1D::applyRows<float>(float const*, float*, int, int, int) const;
+template void SavitzkyGolay1D::applyRows<double>(double const*, double*, int, int, int) const;
+template void SavitzkyGolay1D::applyInterleaved<float>(float const*, float*, int, int) const;
+template void SavitzkyGolay1D::applyInterleaved<double>(double const*, double*, int, int) const;
+
+template class SavitzkyGolayStream<float>;
+template class SavitzkyGolayStream<double>;
@@ -7,8 +7,17 @@
 
 #include "savitzkygolayfilter.h"
 
+#include <algorithm>
+#include <memory>
+#include <string.h>
 
-void smoothSavGolFilter(const cv::Mat &src, cv::Mat &dst, const cv::Size &window_size, const int hor_degree, const int vert_degree)
+
+namespace {
+
+//Pages above this size are split into bands of about this many pixels
+const int BAND_PIXELS = 1 << 20;
+
+void checkArguments(const cv::Mat &src, const cv::Size &window_size, const int hor_degree, const int vert_degree)
 {
     //Check for the conditions
     if(src.type() != CV_8UC1)
@@ -22,221 +31,315 @@ void smoothSavGolFilter(const cv::Mat &src, cv::Mat &dst, const cv::Size &window
 
     if(calcNumTerms(hor_degree,vert_degree) > (window_size.width* window_size.height))
             throw std::invalid_argument("SmoothSavGolFilter: Order is too big for chosen window");
+}
 
+/**
+ * @brief cachedPlan The plan of the last configuration used by the calling
+ *          thread. Consecutive calls with the same window and degrees reuse
+ *          it instead of refactorizing.
+ */
+const SavitzkyGolayPlan& cachedPlan(const cv::Size& window_size, const int hor_degree, const int vert_degree)
+{
+    static thread_local std::unique_ptr<SavitzkyGolayPlan> plan;
 
-    const int width = src.cols;
-    const int height = src.rows;
+    if (!plan || plan->windowSize() != window_size
+            || plan->horDegree() != hor_degree || plan->vertDegree() != vert_degree) {
+        plan.reset(new SavitzkyGolayPlan(window_size, hor_degree, vert_degree));
+    }
 
-    //kernel dimensions
-    const int kw = window_size.width;
-    const int kh = window_size.height;
+    return *plan;
+}
 
-    if(kw > width || kh > height){
-        dst = src.clone();
-        return;
+/**
+ * @brief cachedPlans The plans of the adaptive levels, cached per thread
+ *          like cachedPlan. Plans of levels used by the previous call are
+ *          kept, only new configurations are factorized.
+ */
+std::vector<const SavitzkyGolayPlan*> cachedPlans(const std::vector<SavGolAdaptiveLevel>& levels)
+{
+    static thread_local std::vector<std::unique_ptr<SavitzkyGolayPlan>> plans;
+
+    std::vector<std::unique_ptr<SavitzkyGolayPlan>> kept;
+    std::vector<const SavitzkyGolayPlan*> result;
+    for (const SavGolAdaptiveLevel& level : levels) {
+        auto matches = [&level](const std::unique_ptr<SavitzkyGolayPlan>& plan) {
+            return plan && plan->windowSize() == level.window_size
+                    && plan->horDegree() == level.hor_degree && plan->vertDegree() == level.vert_degree;
+        };
+
+        auto found = std::find_if(kept.begin(), kept.end(), matches);
+        if (found == kept.end()) {
+            auto old = std::find_if(plans.begin(), plans.end(), matches);
+            if (old != plans.end())
+                kept.push_back(std::move(*old));
+            else
+                kept.emplace_back(new SavitzkyGolayPlan(level.window_size, level.hor_degree, level.vert_degree));
+            found = kept.end() - 1;
+        }
+        result.push_back(found->get());
     }
 
-    /*
-     * Consider a 5x5 kernel:
-     * |x|x|T|x|x|
-     * |x|x|T|x|x|
-     * |L|L|C|R|R|
-     * |x|x|B|x|x|
-     * |x|x|B|x|x|
-     */
+    plans = std::move(kept);
+    return result;
+}
 
-    //Coordinates of central point C of the kernel
-    const cv::Point k_center(kw/2,kh/2);
+/**
+ * @brief tileEdgeEnergy Mean of dx^2 + dy^2 over every tile, stored row
+ *          wise, in one pass over the image. Differences reaching past the
+ *          right or bottom edge count as 0.
+ */
+std::vector<double> tileEdgeEnergy(const cv::Mat& src, int tile_size, int cols, int rows)
+{
+    std::vector<int64_t> sums(static_cast<size_t>(cols) * rows, 0);
+    for (int y = 0; y < src.rows; ++y) {
+        uint8_t const* const line = src.ptr<uint8_t>(y);
+        uint8_t const* const next = src.ptr<uint8_t>(std::min(y + 1, src.rows - 1));
+        int64_t* const p_sum = &sums[(y / tile_size) * cols];
+
+        for (int tx = 0; tx < cols; ++tx) {
+            const int x_begin = tx * tile_size;
+            const int x_end = std::min(src.cols, x_begin + tile_size);
+            int64_t sum = 0;
+            for (int x = x_begin; x < std::min(x_end, src.cols - 1); ++x) {
+                const int dx = line[x + 1] - line[x];
+                sum += dx * dx;
+            }
+            for (int x = x_begin; x < x_end; ++x) {
+                const int dy = next[x] - line[x];
+                sum += dy * dy;
+            }
+            p_sum[tx] += sum;
+        }
+    }
 
-    cv::Point k_origin;
+    std::vector<double> energy(sums.size());
+    for (int ty = 0; ty < rows; ++ty) {
+        for (int tx = 0; tx < cols; ++tx) {
+            const int width = std::min(tile_size, src.cols - tx * tile_size);
+            const int height = std::min(tile_size, src.rows - ty * tile_size);
+            energy[ty * cols + tx] = static_cast<double>(sums[ty * cols + tx]) / (static_cast<double>(width) * height);
+        }
+    }
+    return energy;
+}
 
-    //length of the top segment T
-    const int k_top = k_center.y;
+/**
+ * @brief prepareDestination Returns the matrix to filter src into. An
+ *          existing destination of the right size is reused, but filtering
+ *          in place needs a separate output.
+ */
+cv::Mat prepareDestination(const cv::Mat &src, const cv::Mat &dst)
+{
+    cv::Mat out;
+    if (dst.data != src.data)
+        out = dst;
+    out.create(src.size(), CV_8UC1);
+    return out;
+}
 
-    //length of the bottom segment B
-    const int k_bottom = kh - k_top -1;
+}
 
-    //length of the left segment L
-    const int k_left = k_center.x;
 
-    //length of the right segment R
-    const int k_right = kw - k_left - 1;
+void smoothSavGolFilter(const cv::Mat &src, cv::Mat &dst, const cv::Size &window_size, const int hor_degree, const int vert_degree)
+{
+    smoothSavGolFilter(src, dst, window_size, hor_degree, vert_degree, ScratchPool::local());
+}
 
 
-    const uint8_t* src_data = src.data;
-    const int src_bpl = src.step; //bytes per line
+void smoothSavGolFilter(const cv::Mat &src, cv::Mat &dst, const cv::Size &window_size,
+                        const int hor_degree, const int vert_degree, ScratchPool& pool,
+                        SavGolStats* stats)
+{
+    checkArguments(src, window_size, hor_degree, vert_degree);
 
-    dst = cv::Mat::zeros(src.size(),CV_8UC1);
-    uint8_t* const dst_data = dst.data;
-    int const dst_bpl = dst.step;
+    SavGolStatsScope stats_scope(stats);
 
+    //Every pixel gets written, so the destination is not cleared.
+    cv::Mat out = prepareDestination(src, dst);
 
-    // Top-left corner.
-    uint8_t const* src_line = src_data;
-    uint8_t* dst_line = dst_data;
+    const SavitzkyGolayPlan& plan = cachedPlan(window_size, hor_degree, vert_degree);
+    plan.apply(src, out, 0, src.rows, pool);
 
-    SavitzkyGolayFilter kernel(window_size, cv::Point(0, 0), hor_degree, vert_degree);
-    for (int y = 0; y < k_top; ++y, dst_line += dst_bpl) {
-       for (int x = 0; x < k_left; ++x) {
-            k_origin = cv::Point(x,y);
-            kernel.recalcForOrigin(k_origin);
-            kernel.convolve(dst_line + x, src_line, src_bpl);
-        }
-    }
+    dst = out;
+}
 
-    // Top area between two corners.
-   // k_origin.setX(k_center.x());
-    src_line = src_data - k_left;
-    dst_line = dst_data;
-    for (int y = 0; y < k_top; ++y, dst_line += dst_bpl) {
-        k_origin = cv::Point(k_center.x,y);
-        kernel.recalcForOrigin(k_origin);
-        for (int x = k_left; x < width - k_right; ++x) {
-            kernel.convolve(dst_line + x, src_line + x, src_bpl);
-        }
-    }
 
-    // Top-right corner.
-    //k_origin.setY(0);
-    src_line = src_data + width - kw;
-    dst_line = dst_data;
-    for (int y = 0; y < k_top; ++y, dst_line += dst_bpl) {
-        k_origin = cv::Point((k_center.x + 1),0);
-        for (int x = width - k_right; x < width; ++x) {
-            kernel.recalcForOrigin(k_origin);
-            kernel.convolve(dst_line + x, src_line, src_bpl);
-            k_origin = cv::Point(k_origin.x + 1, k_origin.y);
-        }
-        k_origin = cv::Point(k_origin.x, k_origin.y + 1);
-    }
+void smoothSavGolFilter(const cv::Mat &src, cv::Mat &dst, const cv::Size &window_size,
+                        const int hor_degree, const int vert_degree, const SavGolBlankSkip& skip,
+                        SavGolSkipReport* report)
+{
+    checkArguments(src, window_size, hor_degree, vert_degree);
 
-    // Central area.
-    // Take advantage of Savitzky-Golay filter being separable.
-    SavitzkyGolayKernel const hor_kernel(
-        cv::Size(window_size.width, 1),
-        cv::Point(k_center.x, 0), hor_degree, 0
-    );
-    SavitzkyGolayKernel const vert_kernel(
-        cv::Size(1, window_size.height),
-        cv::Point(0, k_center.y), 0, vert_degree
-    );
-
-    int const shift = kw - 1;
-
-    //Savitzky Golay Filter is linearly separable hence we
-    //make use of this and split it into horizontal and vertical
-    //directions
-    int const temp_stride = (width - shift + 3) & ~3;
-    AlignArray<float, 4> temp_array(temp_stride * height);
-
-
-    // Horizontal pass.
-    src_line = src_data - shift;
-    float* temp_line = temp_array.data() - shift;
-    for (int y = 0; y < height; ++y) {
-        for (int i = shift; i < width; ++i) {
-            float sum = 0.0f;
-
-            uint8_t const* src = src_line + i;
-            for (int j = 0; j < kw; ++j) {
-                sum += src[j] * hor_kernel[j];
-            }
-            temp_line[i] = sum;
-        }
-        temp_line += temp_stride;
-        src_line += src_bpl;
-    }
+    if (skip.tile_size < 1)
+        throw std::invalid_argument("SmoothSavGolFilter: invalid tile size!");
 
-    // Vertical pass.
-    dst_line = dst_data + k_top * dst_bpl + k_left - shift;
-    temp_line = temp_array.data() - shift;
-    for (int y = k_top; y < height - k_bottom; ++y) {
-        for (int i = shift; i < width; ++i) {
-            float sum = 0.0f;
+    cv::Mat out = prepareDestination(src, dst);
 
-            float* tmp = temp_line + i;
-            for (int j = 0; j < kh; ++j, tmp += temp_stride) {
-                sum += *tmp * vert_kernel[j];
-            }
-            int const val = static_cast<int>(sum);
-            dst_line[i] = static_cast<uint8_t>(MAX(0, MIN(val, 255)));
-        }
+    const SavitzkyGolayPlan& plan = cachedPlan(window_size, hor_degree, vert_degree);
+    ScratchPool& pool = ScratchPool::local();
 
-        temp_line += temp_stride;
-        dst_line += dst_bpl;
-    }
+    const TileRangeMap tiles(src, skip.tile_size);
+
+    //A pixel reads from windows reaching up to one window size minus one
+    //away, the border windows are pinned to the image edges
+    const int radius_x = (window_size.width - 1 + skip.tile_size - 1) / skip.tile_size;
+    const int radius_y = (window_size.height - 1 + skip.tile_size - 1) / skip.tile_size;
+
+    SavGolSkipReport stats;
+    stats.total_tiles = static_cast<int64_t>(tiles.cols()) * tiles.rows();
+    stats.total_pixels = src.total();
+
+    std::vector<char> blank(tiles.cols());
+    for (int ty = 0; ty < tiles.rows(); ++ty) {
+        for (int tx = 0; tx < tiles.cols(); ++tx)
+            blank[tx] = tiles.neighborhoodRange(tx, ty, radius_x, radius_y) <= skip.threshold;
 
+        int tx = 0;
+        while (tx < tiles.cols()) {
+            const cv::Rect first = tiles.tileRect(tx, ty);
 
-    // Left area between two corners.
-    //k_origin.setX(0);
-    k_origin = cv::Point(0,(k_center.y + 1));
-    for (int x = 0; x < k_left; ++x) {
-        src_line = src_data;
-        dst_line = dst_data + dst_bpl * k_top;
+            if (blank[tx]) {
+                for (int y = first.y; y < first.y + first.height; ++y)
+                    memcpy(out.ptr<uint8_t>(y) + first.x, src.ptr<uint8_t>(y) + first.x, first.width);
+                ++stats.skipped_tiles;
+                stats.skipped_pixels += first.area();
+                ++tx;
+                continue;
+            }
 
-        kernel.recalcForOrigin(k_origin);
-        for (int y = k_top; y < height - k_bottom; ++y) {
-            kernel.convolve(dst_line + x, src_line, src_bpl);
-            src_line += src_bpl;
-            dst_line += dst_bpl;
+            //Neighbouring content tiles are filtered together, which
+            //saves the window overlap between them
+            int run_end = tx + 1;
+            while (run_end < tiles.cols() && !blank[run_end])
+                ++run_end;
+            const cv::Rect last = tiles.tileRect(run_end - 1, ty);
+            plan.apply(src, out, cv::Rect(first.x, first.y, last.x + last.width - first.x, first.height), pool);
+            tx = run_end;
         }
-        k_origin = cv::Point(k_origin.x + 1,k_origin.y);
     }
 
-    // Right area between two corners.
-    k_origin = cv::Point(k_center.x + 1, k_center.y);
-    //k_origin.setY(k_center.y());
-    for (int x = width - k_right; x < width; ++x) {
-        src_line = src_data + width - kw;
-        dst_line = dst_data + dst_bpl * k_top;
-
-        kernel.recalcForOrigin(k_origin);
-        for (int y = k_top; y < height - k_bottom; ++y) {
-            kernel.convolve(dst_line + x, src_line, src_bpl);
-            src_line += src_bpl;
-            dst_line += dst_bpl;
+    if (report)
+        *report = stats;
+
+    dst = out;
+}
+
+
+void smoothSavGolFilter(const cv::Mat &src, cv::Mat &dst, const SavGolAdaptive& adaptive,
+                        std::vector<int64_t>* level_tiles)
+{
+    if (adaptive.levels.empty())
+        throw std::invalid_argument("SmoothSavGolFilter: no adaptive levels!");
+    if (adaptive.tile_size < 1)
+        throw std::invalid_argument("SmoothSavGolFilter: invalid tile size!");
+    for (const SavGolAdaptiveLevel& level : adaptive.levels)
+        checkArguments(src, level.window_size, level.hor_degree, level.vert_degree);
+
+    cv::Mat out = prepareDestination(src, dst);
+
+    const std::vector<const SavitzkyGolayPlan*> plans = cachedPlans(adaptive.levels);
+    ScratchPool& pool = ScratchPool::local();
+
+    const int tile_size = adaptive.tile_size;
+    const int cols = (src.cols + tile_size - 1) / tile_size;
+    const int rows = (src.rows + tile_size - 1) / tile_size;
+    const std::vector<double> energy = tileEdgeEnergy(src, tile_size, cols, rows);
+
+    const int num_levels = static_cast<int>(adaptive.levels.size());
+    std::vector<int64_t> counts(num_levels, 0);
+    std::vector<int> level(cols);
+    for (int ty = 0; ty < rows; ++ty) {
+        for (int tx = 0; tx < cols; ++tx) {
+            int l = 0;
+            while (l < num_levels - 1 && energy[ty * cols + tx] > adaptive.levels[l].max_energy)
+                ++l;
+            level[tx] = l;
+            ++counts[l];
         }
-        k_origin = cv::Point(k_origin.x + 1,k_origin.y);
-    }
 
-    // Bottom-left corner.
-    //k_origin.setY(k_center.y() + 1);
-    k_origin = cv::Point(k_origin.x,k_center.y + 1);
-    src_line = src_data + src_bpl * (height - kh);
-    dst_line = dst_data + dst_bpl * (height - k_bottom);
-    for (int y = height - k_bottom; y < height; ++y, dst_line += dst_bpl) {
-        for (int x = 0; x < k_left; ++x) {
-            k_origin = cv::Point(x,k_origin.y);
-            kernel.recalcForOrigin(k_origin);
-            kernel.convolve(dst_line + x, src_line, src_bpl);
+        //Neighbouring tiles of the same level are filtered together
+        const int y = ty * tile_size;
+        const int height = std::min(tile_size, src.rows - y);
+        int tx = 0;
+        while (tx < cols) {
+            int run_end = tx + 1;
+            while (run_end < cols && level[run_end] == level[tx])
+                ++run_end;
+            const int x = tx * tile_size;
+            const int width = std::min(run_end * tile_size, src.cols) - x;
+            plans[level[tx]]->apply(src, out, cv::Rect(x, y, width, height), pool);
+            tx = run_end;
         }
-        k_origin = cv::Point(k_origin.x,k_origin.y + 1);
     }
 
-    // Bottom area between two corners.
-    k_origin = cv::Point(k_center.x,k_center.y + 1);
-    src_line = src_data + src_bpl * (height - kh) - k_left;
-    dst_line = dst_data + dst_bpl * (height - k_bottom);
-    for (int y = height - k_bottom; y < height; ++y, dst_line += dst_bpl) {
-        kernel.recalcForOrigin(k_origin);
-        for (int x = k_left; x < width - k_right; ++x) {
-            kernel.convolve(dst_line + x, src_line + x, src_bpl);
+    if (level_tiles)
+        *level_tiles = counts;
+
+    dst = out;
+}
+
+
+void smoothSavGolFilterBatch(const std::vector<cv::Mat>& src, std::vector<cv::Mat>& dst,
+                             const cv::Size& window_size, const int hor_degree, const int vert_degree)
+{
+    smoothSavGolFilterBatch(src, dst, window_size, hor_degree, vert_degree, WorkStealingPool::global());
+}
+
+
+void smoothSavGolFilterBatch(const std::vector<cv::Mat>& src, std::vector<cv::Mat>& dst,
+                             const cv::Size& window_size, const int hor_degree, const int vert_degree,
+                             WorkStealingPool& workers, SavGolStats* stats)
+{
+    for (const cv::Mat& page : src)
+        checkArguments(page, window_size, hor_degree, vert_degree);
+
+    SavGolStatsScope stats_scope(stats);
+
+    //Kernels are set up once and shared read only by all workers
+    const SavitzkyGolayPlan& plan = cachedPlan(window_size, hor_degree, vert_degree);
+
+    //Small pages are one band, large pages are split into bands of rows
+    struct Band {
+        size_t page;
+        int row_begin;
+        int row_end;
+    };
+    std::vector<Band> bands;
+    for (size_t i = 0; i < src.size(); ++i) {
+        const int rows = src[i].rows;
+        const int num_bands = std::max(1, static_cast<int>(src[i].total() / BAND_PIXELS));
+        const int band_rows = std::max(window_size.height, (rows + num_bands - 1) / num_bands);
+        for (int row = 0; row < rows; row += band_rows) {
+            Band band = { i, row, std::min(rows, row + band_rows) };
+            bands.push_back(band);
         }
-        k_origin = cv::Point(k_origin.x, k_origin.y + 1);
     }
 
-    // Bottom-right corner.
-    //k_origin.setY(k_center.y() + 1);
-    k_origin = cv::Point(k_origin.x,k_center.y + 1);
-    src_line = src_data + src_bpl * (height - kh) + (width - kw);
-    dst_line = dst_data + dst_bpl * (height - k_bottom);
-    for (int y = height - k_bottom; y < height; ++y, dst_line += dst_bpl) {
-        k_origin = cv::Point(k_center.x + 1, k_origin.y);
-        for (int x = width - k_right; x < width; ++x) {
-            kernel.recalcForOrigin(k_origin);
-            kernel.convolve(dst_line + x, src_line, src_bpl);
-            k_origin = cv::Point(k_origin.x + 1, k_origin.y);
-        }
-        k_origin = cv::Point(k_origin.x,k_origin.y + 1);
+    std::vector<cv::Mat> out(src.size());
+    for (size_t i = 0; i < src.size(); ++i)
+        out[i] = prepareDestination(src[i], i < dst.size() ? dst[i] : cv::Mat());
+
+    //Each task records into its own stats, merged once the batch is done
+    std::vector<SavGolStats> task_stats(stats ? bands.size() : 0);
+
+    std::vector<WorkStealingPool::Task> tasks;
+    for (size_t t = 0; t < bands.size(); ++t) {
+        const cv::Mat* const p_src = &src[bands[t].page];
+        cv::Mat* const p_dst = &out[bands[t].page];
+        const int row_begin = bands[t].row_begin;
+        const int row_end = bands[t].row_end;
+        SavGolStats* const p_stats = stats ? &task_stats[t] : nullptr;
+
+        tasks.push_back([&plan, p_src, p_dst, row_begin, row_end, p_stats] {
+            SavGolStatsScope stats_scope(p_stats);
+            plan.apply(*p_src, *p_dst, row_begin, row_end, ScratchPool::local());
+        });
     }
+
+    workers.run(tasks);
+
+    for (const SavGolStats& s : task_stats)
+        stats->merge(s);
+
+    dst = std::move(out);
 }
@@ -5,9 +5,10 @@
  * Date 26/04/2016
  */
 #include "savitzkygolaykernel.h"
+#include "savitzkygolaystats.h"
+#include <algorithm>
 #include <stdexcept>
 #include <string>
-#include <assert.h>
 #include <math.h>
 
 SavitzkyGolayKernel::SavitzkyGolayKernel(
@@ -29,19 +30,18 @@ SavitzkyGolayKernel::SavitzkyGolayKernel(
         throw std::invalid_argument("Sav Kernel : too high degree");
 
     //Lets allocate some memory now
-    m_dataPoints.resize(m_numDataPoints, 0.0);
-    m_coeffs.resize(m_numTerms);
-    AlignArray<float,4>(m_numDataPoints).swap(m_kernel);
+    m_kernel = AlignArray<float,32>(m_numDataPoints);
 
     //Build equations
-    m_equations.reserve(m_numTerms * m_numDataPoints);
+    std::vector<double> equations;
+    equations.reserve(m_numTerms * m_numDataPoints);
     for (int y = 1; y <= m_height; ++y) {
         for (int x = 1; x <= m_width; ++x) {
             double pow1 = 1.0;
             for (int i = 0; i <= m_vertDegree; ++i) {
                 double pow2 = pow1;
                 for (int j = 0; j <= m_horDegree; ++j) {
-                    m_equations.push_back(pow2);
+                    equations.push_back(pow2);
                     pow2 *= x;
                 }
                 pow1 *= y;
@@ -49,16 +49,18 @@ SavitzkyGolayKernel::SavitzkyGolayKernel(
         }
     }
 
-    QR(); //factorize
+    QR(equations); //factorize
     //recalulate factors now from origin point
     recalcForOrigin(origin);
 }
 
 
-void SavitzkyGolayKernel::QR()
+void SavitzkyGolayKernel::QR(std::vector<double>& equations)
 {
-    m_rotations.clear();
-    m_rotations.reserve(
+    SAVGOL_PROFILE(SAVGOL_QR, m_numDataPoints);
+
+    std::vector<Rotation> rotations;
+    rotations.reserve(
         m_numTerms * (m_numTerms - 1) / 2
         + (m_numDataPoints - m_numTerms) * m_numTerms
     );
@@ -67,11 +69,11 @@ void SavitzkyGolayKernel::QR()
     for (int j = 0; j < m_numTerms; ++j, jj += m_numTerms + 1) {
         int ij = jj + m_numTerms; // i * m_numTerms + j
         for (int i = j + 1; i < m_numDataPoints; ++i, ij += m_numTerms) {
-            double const a = m_equations[jj];
-            double const b = m_equations[ij];
+            double const a = equations[jj];
+            double const b = equations[ij];
 
             if (b == 0.0) {
-                m_rotations.push_back(Rotation(1.0, 0.0));
+                rotations.push_back(Rotation(0.0, 1.0));
                 continue;
             }
 
@@ -80,30 +82,51 @@ void SavitzkyGolayKernel::QR()
             if (a == 0.0) {
                 cos = 0.0;
                 sin = copysign(1.0, b);
-                m_equations[jj] = fabs(b);
+                equations[jj] = fabs(b);
             } else if (fabs(b) > fabs(a)) {
                 double const t = a / b;
                 double const u = copysign(sqrt(1.0 + t*t), b);
                 sin = 1.0 / u;
                 cos = sin * t;
-                m_equations[jj] = b * u;
+                equations[jj] = b * u;
             } else {
                 double const t = b / a;
                 double const u = copysign(sqrt(1.0 + t*t), a);
                 cos = 1.0 / u;
                 sin = cos * t;
-                m_equations[jj] = a * u;
+                equations[jj] = a * u;
             }
-            m_equations[ij] = 0.0;
+            equations[ij] = 0.0;
 
-            m_rotations.push_back(Rotation(sin, cos));
+            rotations.push_back(Rotation(sin, cos));
 
             int ik = ij + 1; // i * m_numTerms + k
             int jk = jj + 1; // j * m_numTerms + k
             for (int k = j + 1; k < m_numTerms; ++k, ++ik, ++jk) {
-                double const temp = cos * m_equations[jk] + sin * m_equations[ik];
-                m_equations[ik] = cos * m_equations[ik] - sin * m_equations[jk];
-                m_equations[jk] = temp;
+                double const temp = cos * equations[jk] + sin * equations[ik];
+                equations[ik] = cos * equations[ik] - sin * equations[jk];
+                equations[jk] = temp;
+            }
+        }
+    }
+
+    // Q1 = Q * [I; 0], the transposed rotations applied in reverse order.
+    // Each rotation mixes two rows of all m_numTerms columns at once.
+    m_basis.assign(m_numDataPoints * m_numTerms, 0.0);
+    for (int t = 0; t < m_numTerms; ++t)
+        m_basis[t * m_numTerms + t] = 1.0;
+
+    std::vector<Rotation>::const_reverse_iterator rot(rotations.rbegin());
+    for (int j = m_numTerms - 1; j >= 0; --j) {
+        double* const row_j = &m_basis[j * m_numTerms];
+        for (int i = m_numDataPoints - 1; i > j; --i, ++rot) {
+            if (rot->sin == 0.0)
+                continue;
+            double* const row_i = &m_basis[i * m_numTerms];
+            for (int k = 0; k < m_numTerms; ++k) {
+                double const temp = rot->cos * row_j[k] - rot->sin * row_i[k];
+                row_i[k] = rot->sin * row_j[k] + rot->cos * row_i[k];
+                row_j[k] = temp;
             }
         }
     }
@@ -112,51 +135,43 @@ void SavitzkyGolayKernel::QR()
 
 void SavitzkyGolayKernel::recalcForOrigin(cv::Point const& origin)
 {
-    std::fill(m_dataPoints.begin(), m_dataPoints.end(), 0.0);
-    m_dataPoints[origin.y * m_width + origin.x] = 1.0;
-
-    // Rotate data points.
-    double* const dp = &m_dataPoints[0];
-    std::vector<Rotation>::const_iterator rot(m_rotations.begin());
-    for (int j = 0; j < m_numTerms; ++j) {
-        for (int i = j + 1; i < m_numDataPoints; ++i, ++rot) {
-            double const temp = rot->cos * dp[j] + rot->sin * dp[i];
-            dp[i] = rot->cos * dp[i] - rot->sin * dp[j];
-            dp[j] = temp;
-        }
-    }
+    kernelBank(std::vector<cv::Point>(1, origin), m_kernel.data(), m_numDataPoints);
+}
 
-    // Solve R*x = d by back-substitution.
-    int ii = m_numTerms * m_numTerms - 1; // i * m_numTerms + i
-    for (int i = m_numTerms - 1; i >= 0; --i, ii -= m_numTerms + 1) {
-        double sum = dp[i];
-        int ik = ii + 1;
-        for (int k = i + 1; k < m_numTerms; ++k, ++ik) {
-            sum -= m_equations[ik] * m_coeffs[k];
-        }
 
-        assert(m_equations[ii] != 0.0);
-        m_coeffs[i] = sum / m_equations[ii];
+void SavitzkyGolayKernel::kernelBank(std::vector<cv::Point> const& origins, float* bank, int stride) const
+{
+    SAVGOL_PROFILE(SAVGOL_RECALC_FOR_ORIGIN, static_cast<int64_t>(origins.size()) * m_numDataPoints);
+
+    //Blocks of origins times blocks of data points, the basis rows of both
+    //stay in cache while the dot products between them are taken.
+    const int ORIGIN_BLOCK = 8;
+    const int POINT_BLOCK = 64;
+    const int num_origins = static_cast<int>(origins.size());
+
+    std::vector<double const*> origin_rows(num_origins);
+    for (int o = 0; o < num_origins; ++o) {
+        cv::Point const& p = origins[o];
+        if (p.x < 0 || p.y < 0 || p.x >= m_width || p.y >= m_height)
+            throw std::invalid_argument("Sav Kernel : origin outside the kernel");
+        origin_rows[o] = &m_basis[(p.y * m_width + p.x) * m_numTerms];
     }
 
-    int ki = 0;
-    for (int y = 1; y <= m_height; ++y) {
-        for (int x = 1; x <= m_width; ++x) {
-            double sum = 0.0;
-            double pow1 = 1.0;
-            int ci = 0;
-            for (int i = 0; i <= m_vertDegree; ++i) {
-                double pow2 = pow1;
-                for (int j = 0; j <= m_horDegree; ++j) {
-                    sum += pow2 * m_coeffs[ci];
-                    ++ci;
-                    pow2 *= x;
+    for (int o_begin = 0; o_begin < num_origins; o_begin += ORIGIN_BLOCK) {
+        const int o_end = std::min(o_begin + ORIGIN_BLOCK, num_origins);
+        for (int k_begin = 0; k_begin < m_numDataPoints; k_begin += POINT_BLOCK) {
+            const int k_end = std::min(k_begin + POINT_BLOCK, m_numDataPoints);
+            for (int o = o_begin; o < o_end; ++o) {
+                double const* const a = origin_rows[o];
+                float* const out = bank + static_cast<size_t>(o) * stride;
+                for (int k = k_begin; k < k_end; ++k) {
+                    double const* const b = &m_basis[k * m_numTerms];
+                    double sum = 0.0;
+                    for (int t = 0; t < m_numTerms; ++t)
+                        sum += a[t] * b[t];
+                    out[k] = static_cast<float>(sum);
                 }
-                pow1 *= y;
             }
-            m_kernel[ki] = (float)sum;
-            ++ki;
         }
     }
 }
-
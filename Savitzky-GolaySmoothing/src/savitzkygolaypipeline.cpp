@@ -0,0 +1,241 @@
+/*
+ * Headless read - filter - write pipeline for directories of scans.
+ */
+#include "savitzkygolaypipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctype.h>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "boundedqueue.h"
+#include "savitzkygolayfilter.h"
+
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief The Page struct An image travelling through the pipeline.
+ */
+struct Page
+{
+    std::string path;
+    cv::Mat image;
+};
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool hasImageExtension(std::string const& path)
+{
+    static const char* const EXTENSIONS[] = {
+        ".tif", ".tiff", ".png", ".jpg", ".jpeg", ".bmp", ".pgm", ".pbm", ".pnm"
+    };
+
+    const size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || path.find_first_of("/\\", dot) != std::string::npos)
+        return false;
+
+    std::string extension = path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+
+    for (const char* known : EXTENSIONS)
+        if (extension == known)
+            return true;
+    return false;
+}
+
+std::string fileName(std::string const& path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+void printStage(std::ostream& os, const char* name, SavGolStageStats const& stage, double wall_seconds)
+{
+    const double megapixels = stage.pixels * 1e-6;
+    os << std::setw(8) << std::left << name << std::right
+       << std::setw(8) << stage.images << " images"
+       << std::setw(10) << std::fixed << std::setprecision(1) << megapixels << " MP"
+       << std::setw(8) << stage.failures << " failed"
+       << std::setw(10) << std::setprecision(2) << (wall_seconds > 0 ? stage.images / wall_seconds : 0.0) << " img/s"
+       << std::setw(10) << (wall_seconds > 0 ? megapixels / wall_seconds : 0.0) << " MP/s"
+       << std::setw(10) << stage.busy_seconds << " s busy"
+       << std::setw(10) << (stage.busy_seconds > 0 ? megapixels / stage.busy_seconds : 0.0) << " MP/s busy\n";
+}
+
+}
+
+
+void SavGolStageStats::merge(SavGolStageStats const& other)
+{
+    images += other.images;
+    pixels += other.pixels;
+    failures += other.failures;
+    busy_seconds += other.busy_seconds;
+}
+
+
+void SavGolPipelineReport::print(std::ostream& os) const
+{
+    const std::ios::fmtflags flags = os.flags();
+    printStage(os, "read", read, wall_seconds);
+    printStage(os, "filter", filter, wall_seconds);
+    printStage(os, "write", write, wall_seconds);
+    os << "wall    " << std::fixed << std::setprecision(2) << wall_seconds << " s\n";
+    os.flags(flags);
+}
+
+
+std::vector<std::string> listImages(std::string const& dir_or_pattern)
+{
+    //A directory lists all of its files
+    std::vector<cv::String> found;
+    cv::glob(dir_or_pattern, found, false);
+
+    const bool pattern = dir_or_pattern.find_first_of("*?") != std::string::npos;
+
+    std::vector<std::string> images;
+    for (cv::String const& path : found) {
+        if (pattern || hasImageExtension(path))
+            images.push_back(path);
+    }
+    std::sort(images.begin(), images.end());
+    return images;
+}
+
+
+SavGolPipelineReport runSavGolPipeline(std::vector<std::string> const& inputs,
+                                       std::string const& output_dir,
+                                       SavGolPipelineConfig const& config)
+{
+    const int num_readers = std::max(1, config.num_readers);
+    const int num_filters = config.num_filters > 0 ? config.num_filters
+                                                   : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const int num_writers = std::max(1, config.num_writers);
+
+    BoundedQueue<Page> decoded(config.queue_depth);
+    BoundedQueue<Page> filtered(config.queue_depth);
+
+    //The last thread of a stage closes its output queue
+    std::atomic<size_t> next_input(0);
+    std::atomic<int> readers_left(num_readers);
+    std::atomic<int> filters_left(num_filters);
+
+    std::vector<SavGolStageStats> read_stats(num_readers);
+    std::vector<SavGolStageStats> filter_stats(num_filters);
+    std::vector<SavGolStageStats> write_stats(num_writers);
+
+    const Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < num_readers; ++t) {
+        threads.emplace_back([&, t] {
+            SavGolStageStats& stats = read_stats[t];
+            for (size_t i = next_input++; i < inputs.size(); i = next_input++) {
+                const Clock::time_point begin = Clock::now();
+                Page page;
+                page.path = inputs[i];
+                page.image = cv::imread(page.path, cv::IMREAD_GRAYSCALE);
+                stats.busy_seconds += secondsSince(begin);
+
+                if (page.image.empty()) {
+                    std::cerr << "[SavGolPipeline] Cannot read " << page.path << "\n";
+                    ++stats.failures;
+                    continue;
+                }
+                ++stats.images;
+                stats.pixels += page.image.total();
+
+                if (!decoded.push(std::move(page)))
+                    break;
+            }
+            if (--readers_left == 0)
+                decoded.close();
+        });
+    }
+
+    for (int t = 0; t < num_filters; ++t) {
+        threads.emplace_back([&, t] {
+            SavGolStageStats& stats = filter_stats[t];
+            const SavGolBlankSkip skip(config.skip_threshold);
+            Page page;
+            while (decoded.pop(page)) {
+                const Clock::time_point begin = Clock::now();
+                Page out;
+                out.path = page.path;
+                try {
+                    if (config.skip_threshold >= 0) {
+                        smoothSavGolFilter(page.image, out.image, config.window_size,
+                                           config.hor_degree, config.vert_degree, skip);
+                    } else {
+                        smoothSavGolFilter(page.image, out.image, config.window_size,
+                                           config.hor_degree, config.vert_degree);
+                    }
+                } catch (std::exception const& e) {
+                    std::cerr << "[SavGolPipeline] Cannot filter " << page.path << ": " << e.what() << "\n";
+                    stats.busy_seconds += secondsSince(begin);
+                    ++stats.failures;
+                    continue;
+                }
+                stats.busy_seconds += secondsSince(begin);
+                ++stats.images;
+                stats.pixels += out.image.total();
+
+                if (!filtered.push(std::move(out)))
+                    break;
+            }
+            if (--filters_left == 0)
+                filtered.close();
+        });
+    }
+
+    for (int t = 0; t < num_writers; ++t) {
+        threads.emplace_back([&, t] {
+            SavGolStageStats& stats = write_stats[t];
+            Page page;
+            while (filtered.pop(page)) {
+                const Clock::time_point begin = Clock::now();
+                const std::string path = output_dir + "/" + fileName(page.path);
+                bool written = false;
+                try {
+                    written = cv::imwrite(path, page.image);
+                } catch (std::exception const& e) {
+                    std::cerr << "[SavGolPipeline] " << e.what() << "\n";
+                }
+                stats.busy_seconds += secondsSince(begin);
+
+                if (!written) {
+                    std::cerr << "[SavGolPipeline] Cannot write " << path << "\n";
+                    ++stats.failures;
+                    continue;
+                }
+                ++stats.images;
+                stats.pixels += page.image.total();
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    SavGolPipelineReport report;
+    report.wall_seconds = secondsSince(start);
+    for (SavGolStageStats const& s : read_stats)
+        report.read.merge(s);
+    for (SavGolStageStats const& s : filter_stats)
+        report.filter.merge(s);
+    for (SavGolStageStats const& s : write_stats)
+        report.write.merge(s);
+    return report;
+}
@@ -0,0 +1,393 @@
+/*
+ * Precomputed Savitzky Golay kernels for one window and degree
+ * configuration.
+ */
+#include "savitzkygolayplan.h"
+
+#include <algorithm>
+#include <vector>
+
+
+namespace {
+
+/**
+ * @brief computeKernels Stores the 1D kernel for every origin of a window of
+ *          length size, each kernel stride floats apart.
+ */
+void computeKernels(float* p_kernel, int size, int stride, int degree, bool horizontal)
+{
+    const cv::Size kernel_size = horizontal ? cv::Size(size, 1) : cv::Size(1, size);
+
+    //Factorize once, every origin's kernel is a row of the projection
+    SavitzkyGolayKernel kernel(kernel_size, cv::Point(0, 0),
+                               horizontal ? degree : 0, horizontal ? 0 : degree);
+    std::vector<cv::Point> origins;
+    for (int i = 0; i < size; ++i)
+        origins.push_back(horizontal ? cv::Point(i, 0) : cv::Point(0, i));
+    kernel.kernelBank(origins, p_kernel, stride);
+}
+
+/**
+ * @brief storeRounded Writes the rounded, saturated value of sum.
+ */
+inline void storeRounded(uint8_t* dst, float sum)
+{
+    const int val = static_cast<int>(sum + 0.5f);
+    *dst = static_cast<uint8_t>(MAX(0, MIN(val, 255)));
+}
+
+/**
+ * @brief verticalPass Sums the size source lines starting at src_top with
+ *          the weights of kernel, one sum per column.
+ */
+void verticalPass(float* out, float const* kernel, int size,
+                  uint8_t const* src_top, int src_bpl, int width)
+{
+    for (int x = 0; x < width; ++x)
+        out[x] = 0.0f;
+
+    for (int j = 0; j < size; ++j, src_top += src_bpl) {
+        const float weight = kernel[j];
+        for (int x = 0; x < width; ++x)
+            out[x] += src_top[x] * weight;
+    }
+}
+
+/**
+ * @brief horizontalDot The horizontal kernel applied to size column sums.
+ */
+inline float horizontalDot(float const* kernel, float const* columns, int size)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < size; ++i)
+        sum += columns[i] * kernel[i];
+    return sum;
+}
+
+/*
+ * Passes of the central area. The window sizes of the DPI table get
+ * versions with the kernel length known at compile time, so the inner
+ * loop unrolls completely. Their centered kernels are symmetric, so the
+ * two samples sharing a weight are added before the multiply, which
+ * halves the multiplies. Other sizes take the generic loops.
+ */
+
+/**
+ * @brief horizontalCenterPass Filters count samples of the source line src.
+ */
+template<int N>
+void horizontalCenterPass(float* out, float const* kernel, uint8_t const* src, int count)
+{
+    for (int o = 0; o < count; ++o, ++src) {
+        float sum = src[N / 2] * kernel[N / 2];
+        for (int j = 0; j < N / 2; ++j)
+            sum += (src[j] + src[N - 1 - j]) * kernel[j];
+        out[o] = sum;
+    }
+}
+
+void horizontalCenterPass(float* out, float const* kernel, int size, uint8_t const* src, int count)
+{
+    switch (size) {
+    case 5:
+        horizontalCenterPass<5>(out, kernel, src, count);
+        return;
+    case 7:
+        horizontalCenterPass<7>(out, kernel, src, count);
+        return;
+    case 11:
+        horizontalCenterPass<11>(out, kernel, src, count);
+        return;
+    }
+
+    for (int o = 0; o < count; ++o, ++src) {
+        float sum = 0.0f;
+        for (int j = 0; j < size; ++j)
+            sum += src[j] * kernel[j];
+        out[o] = sum;
+    }
+}
+
+inline void storeTruncated(uint8_t* dst, float sum)
+{
+    const int val = static_cast<int>(sum);
+    *dst = static_cast<uint8_t>(MAX(0, MIN(val, 255)));
+}
+
+/**
+ * @brief verticalCenterPass Filters count samples whose windows start at the
+ *          temp line temp, lines temp_stride floats apart.
+ */
+template<int N>
+void verticalCenterPass(uint8_t* dst, float const* kernel, float const* temp, int temp_stride, int count)
+{
+    for (int o = 0; o < count; ++o, ++temp) {
+        float sum = temp[(N / 2) * temp_stride] * kernel[N / 2];
+        for (int j = 0; j < N / 2; ++j)
+            sum += (temp[j * temp_stride] + temp[(N - 1 - j) * temp_stride]) * kernel[j];
+        storeTruncated(dst + o, sum);
+    }
+}
+
+void verticalCenterPass(uint8_t* dst, float const* kernel, int size, float const* temp, int temp_stride, int count)
+{
+    switch (size) {
+    case 5:
+        verticalCenterPass<5>(dst, kernel, temp, temp_stride, count);
+        return;
+    case 7:
+        verticalCenterPass<7>(dst, kernel, temp, temp_stride, count);
+        return;
+    case 11:
+        verticalCenterPass<11>(dst, kernel, temp, temp_stride, count);
+        return;
+    }
+
+    for (int o = 0; o < count; ++o, ++temp) {
+        float sum = 0.0f;
+        float const* tmp = temp;
+        for (int j = 0; j < size; ++j, tmp += temp_stride)
+            sum += *tmp * kernel[j];
+        storeTruncated(dst + o, sum);
+    }
+}
+
+}
+
+
+SavitzkyGolayPlan::SavitzkyGolayPlan(cv::Size const& window_size, int hor_degree, int vert_degree) :
+    m_windowSize(window_size),
+    m_horDegree(hor_degree),
+    m_vertDegree(vert_degree),
+    m_horStride((window_size.width + 7) & ~7),
+    m_vertStride((window_size.height + 7) & ~7)
+{
+    const int kw = window_size.width;
+    const int kh = window_size.height;
+
+    SAVGOL_PROFILE(SAVGOL_PLAN_SETUP, 0);
+
+    m_horKernels = AlignArray<float, 32>(static_cast<size_t>(m_horStride) * kw);
+    m_vertKernels = AlignArray<float, 32>(static_cast<size_t>(m_vertStride) * kh);
+
+    computeKernels(m_horKernels.data(), kw, m_horStride, hor_degree, true);
+    computeKernels(m_vertKernels.data(), kh, m_vertStride, vert_degree, false);
+}
+
+
+void SavitzkyGolayPlan::apply(cv::Mat const& src, cv::Mat& dst,
+                              cv::Rect const& region, ScratchPool& pool) const
+{
+    const int width = src.cols;
+    const int height = src.rows;
+
+    //kernel dimensions
+    const int kw = m_windowSize.width;
+    const int kh = m_windowSize.height;
+
+    /*
+     * Consider a 5x5 kernel:
+     * |x|x|T|x|x|
+     * |x|x|T|x|x|
+     * |L|L|C|R|R|
+     * |x|x|B|x|x|
+     * |x|x|B|x|x|
+     */
+
+    //length of the top segment T
+    const int k_top = kh / 2;
+
+    //length of the bottom segment B
+    const int k_bottom = kh - k_top - 1;
+
+    //length of the left segment L
+    const int k_left = kw / 2;
+
+    //length of the right segment R
+    const int k_right = kw - k_left - 1;
+
+    //Offsets of the last window position that fits in the image
+    const int last_x = width - kw;
+    const int last_y = height - kh;
+
+    const uint8_t* const src_data = src.data;
+    const int src_bpl = src.step; //bytes per line
+
+    uint8_t* const dst_data = dst.data;
+    int const dst_bpl = dst.step;
+
+    const int row_begin = region.y;
+    const int row_end = region.y + region.height;
+    const int col_begin = region.x;
+    const int col_end = region.x + region.width;
+
+    //Row ranges of the top border, the central rows and the bottom border
+    //clipped to the requested region
+    const int top_end = std::min(k_top, row_end);
+    const int mid_begin = std::max(k_top, row_begin);
+    const int mid_end = std::min(height - k_bottom, row_end);
+    const int bottom_begin = std::max(height - k_bottom, row_begin);
+
+    const int top_rows = std::max(0, top_end - row_begin);
+    const int mid_rows = std::max(0, mid_end - mid_begin);
+    const int bottom_rows = std::max(0, row_end - bottom_begin);
+
+    //Column ranges of the left area, the central columns and the right area
+    const int left_end = std::min(k_left, col_end);
+    const int center_begin = std::max(k_left, col_begin);
+    const int center_end = std::min(width - k_right, col_end);
+    const int right_begin = std::max(width - k_right, col_begin);
+    const int center_width = std::max(0, center_end - center_begin);
+
+    /*
+     * Top and bottom borders: the window is pinned to the first or last
+     * rows, so every output row has its own vertical kernel. A vertical
+     * pass per output row sums the window rows for the columns the region
+     * reads, then the three areas apply the horizontal kernel of their
+     * origin.
+     */
+    auto border = [&](int y_begin, int y_end, int window_y,
+                      SavGolSection left, SavGolSection center, SavGolSection right) {
+        const int rows = y_end - y_begin;
+        uint8_t const* const src_window = src_data + window_y * src_bpl;
+
+        //Columns read by the windows of the first and last output column
+        const int first_column = std::min(std::max(col_begin - k_left, 0), last_x);
+        const int last_column = std::min(std::max(col_end - 1 - k_left, 0), last_x) + kw;
+        const int num_columns = last_column - first_column;
+
+        //rows are padded to 8 floats so every line starts 32-byte aligned
+        const int column_stride = (num_columns + 7) & ~7;
+        ScratchBuffer<float> columns = pool.acquire<float>(column_stride * rows);
+
+        {
+            SAVGOL_PROFILE(center, rows * center_width);
+            for (int y = y_begin; y < y_end; ++y) {
+                verticalPass(columns.data() + (y - y_begin) * column_stride, vertKernel(y - window_y), kh,
+                             src_window + first_column, src_bpl, num_columns);
+            }
+
+            float const* const p_center = horKernel(k_left);
+            for (int y = y_begin; y < y_end; ++y) {
+                uint8_t* const dst_line = dst_data + y * dst_bpl;
+                float const* const p_columns = columns.data() + (y - y_begin) * column_stride;
+                for (int x = center_begin; x < center_end; ++x) {
+                    storeRounded(dst_line + x,
+                                 horizontalDot(p_center, p_columns + x - k_left - first_column, kw));
+                }
+            }
+        }
+
+        {
+            SAVGOL_PROFILE(left, rows * std::max(0, left_end - col_begin));
+            for (int y = y_begin; y < y_end; ++y) {
+                uint8_t* const dst_line = dst_data + y * dst_bpl;
+                float const* const p_columns = columns.data() + (y - y_begin) * column_stride;
+                for (int x = col_begin; x < left_end; ++x) {
+                    storeRounded(dst_line + x, horizontalDot(horKernel(x), p_columns - first_column, kw));
+                }
+            }
+        }
+
+        {
+            SAVGOL_PROFILE(right, rows * std::max(0, col_end - right_begin));
+            for (int y = y_begin; y < y_end; ++y) {
+                uint8_t* const dst_line = dst_data + y * dst_bpl;
+                float const* const p_columns = columns.data() + (y - y_begin) * column_stride;
+                for (int x = right_begin; x < col_end; ++x) {
+                    storeRounded(dst_line + x,
+                                 horizontalDot(horKernel(x - last_x), p_columns + last_x - first_column, kw));
+                }
+            }
+        }
+    };
+
+    /*
+     * Left and right areas between the corners: the window is pinned to
+     * the first or last columns while the vertical kernel is centered. A
+     * horizontal pass per source row computes the columns x_begin..x_end,
+     * the vertical pass then runs down each of them.
+     */
+    auto side = [&](int x_begin, int x_end, int window_x, SavGolSection section) {
+        const int columns = x_end - x_begin;
+        if (columns <= 0)
+            return;
+
+        SAVGOL_PROFILE(section, mid_rows * columns);
+
+        const int temp_rows = mid_rows + kh - 1;
+        ScratchBuffer<float> temp = pool.acquire<float>(columns * temp_rows);
+
+        uint8_t const* src_line = src_data + (mid_begin - k_top) * src_bpl + window_x;
+        for (int r = 0; r < temp_rows; ++r, src_line += src_bpl) {
+            float* const temp_line = temp.data() + r * columns;
+            for (int x = x_begin; x < x_end; ++x) {
+                float const* const p_kernel = horKernel(x - window_x);
+                float sum = 0.0f;
+                for (int i = 0; i < kw; ++i)
+                    sum += src_line[i] * p_kernel[i];
+                temp_line[x - x_begin] = sum;
+            }
+        }
+
+        float const* const p_vert = vertKernel(k_top);
+        for (int y = mid_begin; y < mid_end; ++y) {
+            uint8_t* const dst_line = dst_data + y * dst_bpl;
+            float const* const temp_top = temp.data() + (y - mid_begin) * columns;
+            for (int x = x_begin; x < x_end; ++x) {
+                float const* tmp = temp_top + x - x_begin;
+                float sum = 0.0f;
+                for (int j = 0; j < kh; ++j, tmp += columns)
+                    sum += *tmp * p_vert[j];
+                storeRounded(dst_line + x, sum);
+            }
+        }
+    };
+
+    if (top_rows > 0)
+        border(row_begin, top_end, 0, SAVGOL_TOP_LEFT, SAVGOL_TOP, SAVGOL_TOP_RIGHT);
+
+    if (mid_rows > 0) {
+        side(col_begin, left_end, 0, SAVGOL_LEFT);
+        side(right_begin, col_end, last_x, SAVGOL_RIGHT);
+    }
+
+    if (mid_rows > 0 && center_width > 0) {
+        // Central area.
+        // Take advantage of Savitzky-Golay filter being separable.
+        SAVGOL_PROFILE(SAVGOL_CENTER, mid_rows * center_width);
+        float const* const hor_kernel = horKernel(k_left);
+        float const* const vert_kernel = vertKernel(k_top);
+
+        //Savitzky Golay Filter is linearly separable hence we
+        //make use of this and split it into horizontal and vertical
+        //directions. Only the source rows and columns feeding the
+        //region are passed horizontally.
+        //rows are padded to 8 floats so every line starts 32-byte aligned
+        int const temp_stride = (center_width + 7) & ~7;
+        int const temp_rows = mid_rows + kh - 1;
+        ScratchBuffer<float> temp_array = pool.acquire<float>(temp_stride * temp_rows);
+
+
+        // Horizontal pass.
+        uint8_t const* src_line = src_data + (mid_begin - k_top) * src_bpl + center_begin - k_left;
+        float* temp_line = temp_array.data();
+        for (int y = 0; y < temp_rows; ++y) {
+            horizontalCenterPass(temp_line, hor_kernel, kw, src_line, center_width);
+            temp_line += temp_stride;
+            src_line += src_bpl;
+        }
+
+        // Vertical pass.
+        uint8_t* dst_line = dst_data + mid_begin * dst_bpl + center_begin;
+        temp_line = temp_array.data();
+        for (int y = mid_begin; y < mid_end; ++y) {
+            verticalCenterPass(dst_line, vert_kernel, kh, temp_line, temp_stride, center_width);
+            temp_line += temp_stride;
+            dst_line += dst_bpl;
+        }
+    }
+
+    if (bottom_rows > 0)
+        border(bottom_begin, row_end, last_y, SAVGOL_BOTTOM_LEFT, SAVGOL_BOTTOM, SAVGOL_BOTTOM_RIGHT);
+}
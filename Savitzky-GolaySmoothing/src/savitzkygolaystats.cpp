@@ -0,0 +1,133 @@
+/*
+ * Optional instrumentation of the Savitzky Golay filter.
+ */
+#include "savitzkygolaystats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+
+namespace {
+
+const char* const SECTION_NAMES[SAVGOL_NUM_SECTIONS] = {
+    "top-left", "top", "top-right",
+    "left", "center", "right",
+    "bottom-left", "bottom", "bottom-right",
+    "plan-setup", "qr", "recalc-for-origin"
+};
+
+thread_local SavGolStats* t_currentStats = nullptr;
+
+/**
+ * @brief threadIndex Small sequential thread ids for the trace viewer.
+ */
+int threadIndex()
+{
+    static std::atomic<int> next_index(1);
+    static thread_local int index = next_index++;
+    return index;
+}
+
+}
+
+
+const char* savGolSectionName(SavGolSection section)
+{
+    return SECTION_NAMES[section];
+}
+
+
+void SavGolStats::reset()
+{
+    for (int i = 0; i < SAVGOL_NUM_SECTIONS; ++i) {
+        sections[i].nanoseconds = 0;
+        sections[i].pixels = 0;
+        sections[i].calls = 0;
+    }
+    events.clear();
+}
+
+
+void SavGolStats::merge(SavGolStats const& other)
+{
+    for (int i = 0; i < SAVGOL_NUM_SECTIONS; ++i) {
+        sections[i].nanoseconds += other.sections[i].nanoseconds;
+        sections[i].pixels += other.sections[i].pixels;
+        sections[i].calls += other.sections[i].calls;
+    }
+    events.insert(events.end(), other.events.begin(), other.events.end());
+}
+
+
+int64_t SavGolStats::filterNanoseconds() const
+{
+    int64_t ns = 0;
+    for (int i = SAVGOL_TOP_LEFT; i <= SAVGOL_BOTTOM_RIGHT; ++i)
+        ns += sections[i].nanoseconds;
+    return ns;
+}
+
+
+void writeChromeTrace(std::ostream& os, SavGolStats const& stats)
+{
+    int64_t origin = std::numeric_limits<int64_t>::max();
+    for (SavGolStats::TraceEvent const& e : stats.events)
+        origin = std::min(origin, e.start_ns);
+
+    os << "{\"traceEvents\":[";
+    for (size_t i = 0; i < stats.events.size(); ++i) {
+        SavGolStats::TraceEvent const& e = stats.events[i];
+        os << (i ? ",\n" : "\n")
+           << "{\"name\":\"" << savGolSectionName(e.section) << "\""
+           << ",\"cat\":\"savgol\",\"ph\":\"X\",\"pid\":1"
+           << ",\"tid\":" << e.thread
+           << ",\"ts\":" << (e.start_ns - origin) / 1000.0
+           << ",\"dur\":" << e.duration_ns / 1000.0
+           << ",\"args\":{\"pixels\":" << e.pixels << "}}";
+    }
+    os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+
+SavGolStatsScope::SavGolStatsScope(SavGolStats* stats) :
+    m_pPrevious(t_currentStats)
+{
+    t_currentStats = stats;
+}
+
+
+SavGolStatsScope::~SavGolStatsScope()
+{
+    t_currentStats = m_pPrevious;
+}
+
+
+SavGolStats* SavGolStatsScope::current()
+{
+    return t_currentStats;
+}
+
+
+SavGolScopedTimer::~SavGolScopedTimer()
+{
+    if (!m_pStats)
+        return;
+
+    using namespace std::chrono;
+    steady_clock::time_point const end = steady_clock::now();
+    int64_t const ns = duration_cast<nanoseconds>(end - m_start).count();
+
+    SavGolStats::Section& s = m_pStats->sections[m_section];
+    s.nanoseconds += ns;
+    s.pixels += m_pixels;
+    ++s.calls;
+
+    SavGolStats::TraceEvent e;
+    e.section = m_section;
+    e.thread = threadIndex();
+    e.start_ns = duration_cast<nanoseconds>(m_start.time_since_epoch()).count();
+    e.duration_ns = ns;
+    e.pixels = m_pixels;
+    m_pStats->events.push_back(e);
+}
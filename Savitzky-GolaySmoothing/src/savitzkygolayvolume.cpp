@@ -0,0 +1,226 @@
+/*
+ * Savitzky Golay smoothing of image stacks.
+ */
+#include "savitzkygolayvolume.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "scratchpool.h"
+
+
+namespace {
+
+/**
+ * @brief checkWindow Every 1D fit needs more samples than coefficients.
+ */
+int checkWindow(int window, int degree, const char* message)
+{
+    if (window < 1 || degree < 0 || degree >= window)
+        throw std::invalid_argument(message);
+    return window;
+}
+
+cv::Size checkPlaneWindow(cv::Size const& window_size, int hor_degree, int vert_degree)
+{
+    return cv::Size(checkWindow(window_size.width, hor_degree, "SmoothSavGolFilter3D: invalid horizontal window or degree!"),
+                    checkWindow(window_size.height, vert_degree, "SmoothSavGolFilter3D: invalid vertical window or degree!"));
+}
+
+}
+
+
+SavitzkyGolayVolumeFilter::SavitzkyGolayVolumeFilter(cv::Size const& window_size, int depth_window,
+                                                     int hor_degree, int vert_degree, int depth_degree) :
+    m_depthWindow(checkWindow(depth_window, depth_degree, "SmoothSavGolFilter3D: invalid depth window or degree!")),
+    m_plane(checkPlaneWindow(window_size, hor_degree, vert_degree), hor_degree, vert_degree),
+    m_depth(cv::Size(depth_window, 1), depth_degree, 0),
+    m_planeStride(0),
+    m_numPushed(0),
+    m_numEmitted(0),
+    m_finished(false)
+{
+}
+
+
+void SavitzkyGolayVolumeFilter::reset()
+{
+    m_numPushed = 0;
+    m_numEmitted = 0;
+    m_finished = false;
+    m_ready.clear();
+}
+
+
+void SavitzkyGolayVolumeFilter::push(cv::Mat const& slice)
+{
+    if (m_finished)
+        throw std::invalid_argument("SmoothSavGolFilter3D: push after finish!");
+
+    if (slice.type() != CV_8UC1)
+        throw std::invalid_argument("SmoothSavGolFilter3D: The input slice type is invalid (!GrayScale)");
+
+    if (m_numPushed == 0) {
+        const cv::Size& window = m_plane.windowSize();
+        if (window.width > slice.cols || window.height > slice.rows)
+            throw std::invalid_argument("SmoothSavGolFilter3D: invalid window size!");
+
+        //The ring is kept between stacks of the same slice size
+        const int stride = (slice.cols * slice.rows + 7) & ~7;
+        if (stride != m_planeStride || slice.size() != m_sliceSize)
+            m_ring = AlignArray<float, 32>(static_cast<size_t>(stride) * m_depthWindow);
+        m_sliceSize = slice.size();
+        m_planeStride = stride;
+    } else if (slice.size() != m_sliceSize) {
+        throw std::invalid_argument("SmoothSavGolFilter3D: slices differ in size!");
+    }
+
+    //Slice n replaces slice n - depth_window, whose last use was the
+    //output emitted by the previous push
+    const int n = m_numPushed++;
+    filterPlane(slice, m_ring.data() + static_cast<size_t>(n % m_depthWindow) * m_planeStride);
+
+    const int k_front = m_depthWindow / 2;
+    const int k_back = m_depthWindow - k_front - 1;
+
+    if (m_numPushed == m_depthWindow) {
+        //The front slices and the first centered one share the first window
+        for (int z = 0; z <= k_front; ++z)
+            emit(z, 0);
+    } else if (m_numPushed > m_depthWindow) {
+        const int z = n - k_back;
+        emit(z, z - k_front);
+    }
+}
+
+
+void SavitzkyGolayVolumeFilter::finish()
+{
+    if (m_finished)
+        return;
+
+    if (m_numPushed < m_depthWindow)
+        throw std::invalid_argument("SmoothSavGolFilter3D: the stack is smaller than the depth window!");
+
+    m_finished = true;
+
+    //The back slices share the last window
+    const int last_z = m_numPushed - m_depthWindow;
+    for (int z = m_numEmitted; z < m_numPushed; ++z)
+        emit(z, last_z);
+}
+
+
+bool SavitzkyGolayVolumeFilter::pop(cv::Mat& slice)
+{
+    if (m_ready.empty())
+        return false;
+
+    slice = m_ready.front();
+    m_ready.pop_front();
+    return true;
+}
+
+
+void SavitzkyGolayVolumeFilter::filterPlane(cv::Mat const& slice, float* out) const
+{
+    const int width = slice.cols;
+    const int height = slice.rows;
+    const int kw = m_plane.windowSize().width;
+    const int kh = m_plane.windowSize().height;
+    const int k_left = kw / 2;
+    const int k_top = kh / 2;
+    const int last_x = width - kw;
+    const int last_y = height - kh;
+
+    ScratchBuffer<float> rows = ScratchPool::local().acquire<float>(static_cast<size_t>(width) * height);
+
+    // Horizontal pass, the window of every column pinned inside the slice.
+    for (int y = 0; y < height; ++y) {
+        uint8_t const* const src_line = slice.ptr<uint8_t>(y);
+        float* const row = rows.data() + y * width;
+        for (int x = 0; x < width; ++x) {
+            const int window_x = std::min(std::max(x - k_left, 0), last_x);
+            float const* const kernel = m_plane.horKernel(x - window_x);
+            uint8_t const* const src = src_line + window_x;
+
+            float sum = 0.0f;
+            for (int i = 0; i < kw; ++i)
+                sum += src[i] * kernel[i];
+            row[x] = sum;
+        }
+    }
+
+    // Vertical pass, whole rows at a time.
+    for (int y = 0; y < height; ++y) {
+        const int window_y = std::min(std::max(y - k_top, 0), last_y);
+        float const* const kernel = m_plane.vertKernel(y - window_y);
+        float* const out_line = out + y * width;
+
+        for (int x = 0; x < width; ++x)
+            out_line[x] = 0.0f;
+        for (int j = 0; j < kh; ++j) {
+            const float weight = kernel[j];
+            float const* const row = rows.data() + (window_y + j) * width;
+            for (int x = 0; x < width; ++x)
+                out_line[x] += row[x] * weight;
+        }
+    }
+}
+
+
+void SavitzkyGolayVolumeFilter::emit(int z, int window_z)
+{
+    const int num_pixels = m_sliceSize.area();
+    float const* const kernel = m_depth.horKernel(z - window_z);
+
+    ScratchBuffer<float> sums = ScratchPool::local().acquire<float>(num_pixels);
+    float* const p_sums = sums.data();
+    for (int i = 0; i < num_pixels; ++i)
+        p_sums[i] = 0.0f;
+
+    // Depth pass over the ring.
+    for (int k = 0; k < m_depthWindow; ++k) {
+        const float weight = kernel[k];
+        float const* const plane = m_ring.data()
+                + static_cast<size_t>((window_z + k) % m_depthWindow) * m_planeStride;
+        for (int i = 0; i < num_pixels; ++i)
+            p_sums[i] += plane[i] * weight;
+    }
+
+    cv::Mat slice(m_sliceSize, CV_8UC1);
+    for (int y = 0; y < slice.rows; ++y) {
+        uint8_t* const dst_line = slice.ptr<uint8_t>(y);
+        float const* const sum_line = p_sums + y * slice.cols;
+        for (int x = 0; x < slice.cols; ++x) {
+            const int val = static_cast<int>(sum_line[x] + 0.5f);
+            dst_line[x] = static_cast<uint8_t>(MAX(0, MIN(val, 255)));
+        }
+    }
+
+    m_ready.push_back(slice);
+    ++m_numEmitted;
+}
+
+
+void smoothSavGolFilter3D(std::vector<cv::Mat> const& src, std::vector<cv::Mat>& dst,
+                          cv::Size const& window_size, int depth_window,
+                          int hor_degree, int vert_degree, int depth_degree)
+{
+    SavitzkyGolayVolumeFilter filter(window_size, depth_window, hor_degree, vert_degree, depth_degree);
+
+    std::vector<cv::Mat> out;
+    out.reserve(src.size());
+
+    cv::Mat slice;
+    for (cv::Mat const& s : src) {
+        filter.push(s);
+        while (filter.pop(slice))
+            out.push_back(slice);
+    }
+    filter.finish();
+    while (filter.pop(slice))
+        out.push_back(slice);
+
+    dst = std::move(out);
+}
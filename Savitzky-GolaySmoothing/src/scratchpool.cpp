@@ -0,0 +1,72 @@
+/*
+ * A pool of reusable aligned scratch buffers.
+ */
+#include "scratchpool.h"
+
+
+namespace {
+
+//Smallest block handed out by the pool, in bytes
+size_t const MIN_BLOCK_SIZE = 256;
+
+/**
+ * @brief sizeClass Returns the index of the smallest power of two
+ *          size class holding the requested number of bytes.
+ */
+size_t sizeClass(size_t bytes)
+{
+    size_t cls = 0;
+    size_t block_size = MIN_BLOCK_SIZE;
+    while (block_size < bytes) {
+        block_size <<= 1;
+        ++cls;
+    }
+    return cls;
+}
+
+}
+
+
+ScratchPool::Block ScratchPool::take(size_t bytes)
+{
+    size_t const cls = sizeClass(bytes);
+    if (cls < m_freeBlocks.size() && !m_freeBlocks[cls].empty()) {
+        Block block(std::move(m_freeBlocks[cls].back()));
+        m_freeBlocks[cls].pop_back();
+        return block;
+    }
+
+    ++m_numAllocations;
+    return Block(MIN_BLOCK_SIZE << cls);
+}
+
+
+void ScratchPool::giveBack(Block&& block)
+{
+    size_t const cls = sizeClass(block.size());
+    if (cls >= m_freeBlocks.size())
+        m_freeBlocks.resize(cls + 1);
+    m_freeBlocks[cls].push_back(std::move(block));
+}
+
+
+void ScratchPool::trim()
+{
+    m_freeBlocks.clear();
+}
+
+
+size_t ScratchPool::cachedBytes() const
+{
+    size_t bytes = 0;
+    for (size_t cls = 0; cls < m_freeBlocks.size(); ++cls)
+        bytes += m_freeBlocks[cls].size() * (MIN_BLOCK_SIZE << cls);
+    return bytes;
+}
+
+
+ScratchPool& ScratchPool::local()
+{
+    static thread_local ScratchPool pool;
+    return pool;
+}
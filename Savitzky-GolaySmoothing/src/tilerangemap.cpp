@@ -0,0 +1,65 @@
+/*
+ * Per tile minimum and maximum of an 8 bit image.
+ */
+#include "tilerangemap.h"
+
+#include <algorithm>
+
+
+TileRangeMap::TileRangeMap(cv::Mat const& image, int tile_size) :
+    m_tileSize(tile_size),
+    m_width(image.cols),
+    m_height(image.rows),
+    m_cols((image.cols + tile_size - 1) / tile_size),
+    m_rows((image.rows + tile_size - 1) / tile_size),
+    m_min(static_cast<size_t>(m_cols) * m_rows, 255),
+    m_max(static_cast<size_t>(m_cols) * m_rows, 0)
+{
+    //One pass over the image, line by line; each line updates the tiles
+    //of its tile row
+    for (int y = 0; y < m_height; ++y) {
+        uint8_t const* const line = image.ptr<uint8_t>(y);
+        uint8_t* const p_min = &m_min[(y / tile_size) * m_cols];
+        uint8_t* const p_max = &m_max[(y / tile_size) * m_cols];
+
+        for (int tx = 0; tx < m_cols; ++tx) {
+            const int x_end = std::min(m_width, (tx + 1) * tile_size);
+            uint8_t lo = p_min[tx];
+            uint8_t hi = p_max[tx];
+            for (int x = tx * tile_size; x < x_end; ++x) {
+                lo = std::min(lo, line[x]);
+                hi = std::max(hi, line[x]);
+            }
+            p_min[tx] = lo;
+            p_max[tx] = hi;
+        }
+    }
+}
+
+
+cv::Rect TileRangeMap::tileRect(int tx, int ty) const
+{
+    const int x = tx * m_tileSize;
+    const int y = ty * m_tileSize;
+    return cv::Rect(x, y, std::min(m_tileSize, m_width - x), std::min(m_tileSize, m_height - y));
+}
+
+
+int TileRangeMap::neighborhoodRange(int tx, int ty, int radius_x, int radius_y) const
+{
+    const int tx_begin = std::max(0, tx - radius_x);
+    const int tx_end = std::min(m_cols, tx + radius_x + 1);
+    const int ty_begin = std::max(0, ty - radius_y);
+    const int ty_end = std::min(m_rows, ty + radius_y + 1);
+
+    uint8_t lo = 255;
+    uint8_t hi = 0;
+    for (int y = ty_begin; y < ty_end; ++y) {
+        for (int x = tx_begin; x < tx_end; ++x) {
+            lo = std::min(lo, m_min[y * m_cols + x]);
+            hi = std::max(hi, m_max[y * m_cols + x]);
+        }
+    }
+
+    return hi < lo ? 0 : hi - lo;
+}
@@ -0,0 +1,145 @@
+/*
+ * A small work stealing thread pool.
+ */
+#include "workstealingpool.h"
+
+
+WorkStealingPool::WorkStealingPool(int num_threads) :
+    m_generation(0),
+    m_stop(false),
+    m_pending(0)
+{
+    if (num_threads <= 0)
+        num_threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (num_threads <= 0)
+        num_threads = 1;
+
+    for (int i = 0; i < num_threads; ++i)
+        m_queues.push_back(std::unique_ptr<Queue>(new Queue));
+
+    //Worker 0 is the thread calling run()
+    for (int i = 1; i < num_threads; ++i)
+        m_threads.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+}
+
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_stop = true;
+    }
+    m_wakeWorkers.notify_all();
+
+    for (std::thread& t : m_threads)
+        t.join();
+}
+
+
+void WorkStealingPool::run(std::vector<Task>& tasks)
+{
+    if (tasks.empty())
+        return;
+
+    std::lock_guard<std::mutex> run_lock(m_runMutex);
+
+    m_error = nullptr;
+    m_pending = tasks.size();
+
+    //Deal the tasks round robin, neighbouring tasks end up on different workers
+    const size_t num_queues = m_queues.size();
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        Queue& q = *m_queues[i % num_queues];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(std::move(tasks[i]));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        ++m_generation;
+    }
+    m_wakeWorkers.notify_all();
+
+    Task task;
+    while (popOrSteal(0, task))
+        execute(task);
+
+    std::unique_lock<std::mutex> lock(m_stateMutex);
+    m_batchDone.wait(lock, [this] { return m_pending == 0; });
+
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
+
+
+void WorkStealingPool::workerLoop(int index)
+{
+    unsigned seen_generation = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_stateMutex);
+            m_wakeWorkers.wait(lock, [&] { return m_stop || m_generation != seen_generation; });
+            if (m_stop)
+                return;
+            seen_generation = m_generation;
+        }
+
+        Task task;
+        while (popOrSteal(index, task))
+            execute(task);
+    }
+}
+
+
+bool WorkStealingPool::popOrSteal(int index, Task& task)
+{
+    const int num_queues = static_cast<int>(m_queues.size());
+
+    {
+        Queue& own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (int i = 1; i < num_queues; ++i) {
+        Queue& victim = *m_queues[(index + i) % num_queues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void WorkStealingPool::execute(Task& task)
+{
+    try {
+        task();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        if (!m_error)
+            m_error = std::current_exception();
+    }
+    task = Task();
+
+    if (--m_pending == 0) {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_batchDone.notify_all();
+    }
+}
+
+
+WorkStealingPool& WorkStealingPool::global()
+{
+    static WorkStealingPool pool;
+    return pool;
+}
@@ -0,0 +1,281 @@
+#include "Logger.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+
+#include <stdio.h>
+
+namespace pil {
+
+
+namespace {
+
+QVariant loggingValue(const QString& key, const QVariant& defaultValue)
+{
+    const QVariant value = SettingsManager::getValue("logging", key);
+    return value.isValid() ? value : defaultValue;
+}
+
+Logger::Level levelFromMsgType(QtMsgType type)
+{
+    switch (type) {
+    case QtDebugMsg:    return Logger::Debug;
+    case QtInfoMsg:     return Logger::Info;
+    case QtWarningMsg:  return Logger::Warning;
+    case QtCriticalMsg: return Logger::Critical;
+    case QtFatalMsg:    return Logger::Fatal;
+    }
+    return Logger::Debug;
+}
+
+void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg)
+{
+    Logger* logger = Logger::instance();
+    logger->log(levelFromMsgType(type), msg, context.line, context.function);
+
+    //Qt aborts after a fatal message, get it on disk first
+    if (type == QtFatalMsg)
+        logger->flush();
+}
+
+void flushLogAtExit()
+{
+    Logger::instance()->flush();
+}
+
+}
+
+
+Logger::Logger() :
+    mask(0), enqueuePos(0), dequeuePos(0), dropped(0),
+    minLevel("logging", "minLevel", Debug),
+    writerSleeping(false), writtenPos(0), stopWriter(false)
+{
+    //Ring capacity is the next power of two, positions map to cells by mask
+    const int bufferSize = qMax(2, loggingValue("bufferSize", 100).toInt());
+    size_t capacity = 2;
+    while (capacity < static_cast<size_t>(bufferSize))
+        capacity <<= 1;
+    cells.reset(new Cell[capacity]);
+    for (size_t i = 0; i < capacity; ++i)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    mask = capacity - 1;
+
+    //Relative paths are taken from the application directory, like config.ini
+    fileName = QDir(QCoreApplication::applicationDirPath())
+            .absoluteFilePath(loggingValue("fileName", "../logs/PILlog.log").toString());
+    maxSize = loggingValue("maxSize", 1000000).toLongLong();
+    maxBackups = qMax(0, loggingValue("maxBackups", 2).toInt());
+    timestampFormat = loggingValue("timestampFormat", "dd.MM.yyyy hh:mm:ss.zzz").toString();
+    msgFormat = loggingValue("msgFormat", "{timestamp} {typeNr} {type} {msg}").toString();
+
+    writer = std::thread(&Logger::writerLoop, this);
+}
+
+Logger *Logger::instance()
+{
+    //Function local statics are initialized thread safe
+    static Logger* const logger = new Logger();
+
+    static bool const flush_registered = (qAddPostRoutine(flushLogAtExit), true);
+    Q_UNUSED(flush_registered);
+
+    return logger;
+}
+
+const char *Logger::levelName(int level)
+{
+    switch (level) {
+    case Debug:    return "Debug";
+    case Info:     return "Info";
+    case Warning:  return "Warning";
+    case Critical: return "Critical";
+    case Fatal:    return "Fatal";
+    }
+    return "Unknown";
+}
+
+bool Logger::log(Level level, const QString &msg, int line, const char *function)
+{
+    if (level < minLevel.get())
+        return false;
+
+    LogEntry entry = { QDateTime::currentMSecsSinceEpoch(), level, line, function, msg };
+    if (!push(entry)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (writerSleeping.load())
+        wakeWriter();
+    return true;
+}
+
+bool Logger::push(LogEntry &entry)
+{
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &cells[pos & mask];
+        const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            //The writer has not freed this cell yet, the ring is full
+            return false;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    //Sequentially consistent, so it cannot pass the load of writerSleeping
+    //in log(), which pairs with the writer's last look before sleeping
+    cell->entry = std::move(entry);
+    cell->sequence.store(pos + 1);
+    return true;
+}
+
+bool Logger::pop(LogEntry &entry)
+{
+    Cell& cell = cells[dequeuePos & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1)
+        return false;
+
+    entry = std::move(cell.entry);
+    cell.entry.message = QString();
+    cell.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+    ++dequeuePos;
+    return true;
+}
+
+void Logger::wakeWriter()
+{
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wakeCondition.notify_one();
+}
+
+void Logger::writerLoop()
+{
+    LogEntry entry;
+    for (;;) {
+        bool wrote = false;
+        while (pop(entry)) {
+            write(format(entry));
+            wrote = true;
+        }
+        if (wrote)
+            file.flush();
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        writtenPos = dequeuePos;
+        writtenCondition.notify_all();
+
+        //Announce sleeping before the last look at the queue, so a producer
+        //pushing in between either gets popped or wakes us up
+        writerSleeping.store(true);
+        const bool empty = cells[dequeuePos & mask].sequence.load() != dequeuePos + 1;
+
+        if (empty) {
+            if (stopWriter)
+                break;
+            //The timeout only covers producers that stalled mid push
+            wakeCondition.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        writerSleeping.store(false);
+    }
+
+    file.close();
+}
+
+QByteArray Logger::format(const LogEntry &entry) const
+{
+    QString text = msgFormat;
+    text.replace("{timestamp}", QDateTime::fromMSecsSinceEpoch(entry.msecs).toString(timestampFormat));
+    text.replace("{typeNr}", QString::number(entry.level));
+    text.replace("{type}", QLatin1String(levelName(entry.level)));
+    text.replace("{line}", QString::number(entry.line));
+    text.replace("{function}", entry.function ? QString::fromLatin1(entry.function) : QString());
+
+    //Last, so placeholders inside the message are left alone
+    text.replace("{msg}", entry.message);
+    text.append(QLatin1Char('\n'));
+    return text.toUtf8();
+}
+
+void Logger::write(const QByteArray &text)
+{
+    if (!file.isOpen() && !openFile())
+        return;
+
+    if (maxSize > 0 && file.size() > 0 && file.size() + text.size() > maxSize)
+        rotate();
+
+    if (file.isOpen())
+        file.write(text);
+}
+
+bool Logger::openFile()
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    file.setFileName(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Append | QFile::Text)) {
+        //Not through qWarning, it may be routed back into this logger
+        fprintf(stderr, "[Logger] Error Opening %s\n", fileName.toLocal8Bit().constData());
+        return false;
+    }
+    return true;
+}
+
+void Logger::rotate()
+{
+    file.close();
+
+    //fileName.1 is the newest backup, fileName.<maxBackups> the oldest
+    QFile::remove(fileName + QLatin1Char('.') + QString::number(maxBackups));
+    for (int i = maxBackups - 1; i >= 1; --i) {
+        QFile::rename(fileName + QLatin1Char('.') + QString::number(i),
+                      fileName + QLatin1Char('.') + QString::number(i + 1));
+    }
+    if (maxBackups > 0)
+        QFile::rename(fileName, fileName + ".1");
+    else
+        QFile::remove(fileName);
+
+    openFile();
+}
+
+void Logger::flush()
+{
+    const size_t target = enqueuePos.load(std::memory_order_acquire);
+
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    wakeCondition.notify_one();
+    writtenCondition.wait(lock, [this, target] { return writtenPos >= target || stopWriter; });
+}
+
+void Logger::installMessageHandler()
+{
+    instance();
+    qInstallMessageHandler(messageHandler);
+}
+
+quint64 Logger::droppedMessages() const
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+Logger::~Logger()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopWriter = true;
+    }
+    wakeCondition.notify_one();
+    writer.join();
+}
+
+
+}//end of namespace pil
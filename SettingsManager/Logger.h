@@ -0,0 +1,145 @@
+#ifndef Logger_H
+#define Logger_H
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QString>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "SettingsManager.h"
+
+
+namespace pil {
+
+/**
+ * @brief The LogEntry struct One message as handed over to the writer thread.
+ */
+struct LogEntry
+{
+    qint64      msecs;
+    int         level;
+    int         line;
+    const char* function;
+    QString     message;
+};
+
+
+/**
+ * @brief The Logger class Asynchronous logger configured from the "logging"
+ *        section of the SettingsManager.
+ *
+ *        Producers push entries into a bounded lock-free ring buffer and
+ *        return; a background thread formats them with msgFormat and
+ *        timestampFormat, appends them to fileName and rotates the file once
+ *        it grows beyond maxSize, keeping maxBackups old files. When the ring
+ *        buffer (bufferSize entries, rounded up to a power of two) is full the
+ *        entry is dropped and counted instead of blocking the producer.
+ *        minLevel is read on every call, so it can be changed at runtime.
+ */
+class DllCoreExport Logger
+{
+public:
+    enum Level {
+        Debug = 0,
+        Info,
+        Warning,
+        Critical,
+        Fatal
+    };
+
+    static Logger*  instance();
+
+    /**
+     * @brief log Queues a message. Returns false if it was filtered by
+     *        minLevel or dropped because the buffer was full.
+     * @param function Must outlive the logger, e.g. a string literal or
+     *        Q_FUNC_INFO
+     */
+    bool            log(Level level, const QString& msg, int line = 0, const char* function = nullptr);
+
+    /**
+     * @brief flush Returns once all messages queued before the call are
+     *        written to the file.
+     */
+    void            flush();
+
+    /**
+     * @brief installMessageHandler Routes qDebug, qInfo, qWarning, qCritical
+     *        and qFatal through the logger.
+     */
+    static void     installMessageHandler();
+
+    quint64         droppedMessages() const;
+
+    static const char* levelName(int level);
+
+    ~Logger();
+
+private:
+    Logger();
+    Q_DISABLE_COPY(Logger)
+
+    /**
+     * Bounded multi producer, single consumer queue. Every cell carries a
+     * sequence number telling whether it is free for the producer claiming
+     * position pos (sequence == pos) or holds the entry for the consumer
+     * (sequence == pos + 1). Producers claim positions with a CAS on
+     * enqueuePos, the writer thread alone advances dequeuePos.
+     */
+    struct Cell {
+        std::atomic<size_t> sequence;
+        LogEntry entry;
+    };
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    std::atomic<size_t> enqueuePos;
+    size_t dequeuePos;
+    std::atomic<quint64> dropped;
+
+    bool push(LogEntry& entry);
+    bool pop(LogEntry& entry);
+
+    //Configuration, fixed once the logger runs
+    Setting<int> minLevel;
+    QString fileName;
+    qint64 maxSize;
+    int maxBackups;
+    QString timestampFormat;
+    QString msgFormat;
+
+    //Writer thread state. Producers only take the mutex to wake it up.
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable writtenCondition;
+    std::atomic<bool> writerSleeping;
+    size_t writtenPos;
+    bool stopWriter;
+    std::thread writer;
+
+    QFile file;
+
+    void writerLoop();
+    void wakeWriter();
+    QByteArray format(const LogEntry& entry) const;
+    void write(const QByteArray& text);
+    bool openFile();
+    void rotate();
+};
+
+
+}//end of namespace pil
+
+
+#define PIL_LOG(level, msg) pil::Logger::instance()->log((level), (msg), __LINE__, Q_FUNC_INFO)
+#define PIL_LOG_DEBUG(msg)    PIL_LOG(pil::Logger::Debug, msg)
+#define PIL_LOG_INFO(msg)     PIL_LOG(pil::Logger::Info, msg)
+#define PIL_LOG_WARNING(msg)  PIL_LOG(pil::Logger::Warning, msg)
+#define PIL_LOG_CRITICAL(msg) PIL_LOG(pil::Logger::Critical, msg)
+
+#endif // Logger_H
@@ -1,92 +1,469 @@
 #include "SettingsManager.h"
 #include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QPair>
+#include <QThread>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <stdio.h>
+#endif
 
 namespace pil {
 
 
-SettingsManager* SettingsManager::_instance = 0;
+namespace {
+
+/**
+ * @brief replaceFile Atomically replaces target with source.
+ */
+bool replaceFile(const QString& source, const QString& target)
+{
+#ifdef Q_OS_WIN
+    return MoveFileExW(reinterpret_cast<const wchar_t*>(source.utf16()),
+                       reinterpret_cast<const wchar_t*>(target.utf16()),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return ::rename(QFile::encodeName(source).constData(),
+                    QFile::encodeName(target).constData()) == 0;
+#endif
+}
+
+void flushAtExit()
+{
+    SettingsManager::flush();
+}
+
+/**
+ * @brief sameValue Compares values independent of whether they came from
+ *        the ini file, as strings, or from setValue, as their own types.
+ */
+bool sameValue(const QVariant& a, const QVariant& b)
+{
+    if (a.isValid() != b.isValid())
+        return false;
+    if (a.userType() == b.userType())
+        return a == b;
+    return a.canConvert<QString>() && b.canConvert<QString>() && a.toString() == b.toString();
+}
+
+void splitPath(const QString& path, QString& section, QString& key)
+{
+    const int slash = path.lastIndexOf(QLatin1Char('/'));
+    section = slash < 0 ? QString() : path.left(slash);
+    key = path.mid(slash + 1);
+}
+
+}
 
 
-SettingsManager::SettingsManager(QObject *parent) : QObject(parent)
+SettingsManager::SettingsManager(QObject *parent) : QObject(parent),
+    snapshot(nullptr), readerIndex(0),
+    dirtyCount(0), flushIntervalMs(1000), flushMaxDirty(64),
+    reloadRequested(false), stopFlusher(false),
+    generation(0), persistedGeneration(0)
 {
-    this->sets = new QSettings(QCoreApplication::applicationDirPath()+"/config.ini", QSettings::IniFormat);
+    readers[0] = 0;
+    readers[1] = 0;
+
+    this->configPath = QCoreApplication::applicationDirPath()+"/config.ini";
+
+    if(!QFile(configPath).exists()) {
+        qInfo()<<"[SettingsManager] Error Accessing path";
+    }
+
+    {
+        QMutexLocker lock(&writeMutex);
+        publishFromSettings();
+        diskValues = snapshot.load()->values;
+    }
+
+    //Saving replaces config.ini, which drops it from the watcher. The
+    //directory is watched as well to pick the file up again.
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, &QFileSystemWatcher::fileChanged, this, &SettingsManager::configFileChanged);
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &SettingsManager::configFileChanged);
+    watchConfigFile();
+
+    flusher = std::thread(&SettingsManager::flusherLoop, this);
     qDebug()<<"[SettingsManager] Creating Settings Singleton";
 }
 
 SettingsManager *SettingsManager::instance()
 {
-    if (_instance == 0) _instance = new SettingsManager();
-    return _instance;
+    //Function local statics are initialized thread safe
+    static SettingsManager* const manager = new SettingsManager();
+
+    //Pending changes are written when the application object goes away
+    static bool const flush_registered = (qAddPostRoutine(flushAtExit), true);
+    Q_UNUSED(flush_registered);
+
+    return manager;
 }
 
-QVariant SettingsManager::getValue(QString key)
+QVariant SettingsManager::readValue(const QString &path) const
 {
-    QSettings* config = instance()->sets;
-    return config->value(key);
+    const int index = readerIndex.load();
+    readers[index].fetch_add(1);
+
+    //The writer cannot free this snapshot until the counter drops again
+    const SettingsSnapshot* current = snapshot.load();
+    QVariant returnValue = current->values.value(path);
+
+    readers[index].fetch_sub(1);
+    return returnValue;
 }
 
-QVariant SettingsManager::getValue(QString section, QString key)
+void SettingsManager::publish(SettingsSnapshot *next)
 {
-    QMutex m;
-    m.lock();
-    QSettings* config = instance()->sets;
+    resolveSlots(next);
+
+    const SettingsSnapshot* old = snapshot.exchange(next);
+    if (!old)
+        return;
 
-    if(config->status() == QSettings::AccessError){
+    //Readers that entered before the exchange may still use the old
+    //snapshot. Wait for the idle counter to drain, move new readers
+    //onto it, then wait for the previously active counter.
+    const int index = readerIndex.load();
+    while (readers[1 - index].load() != 0)
+        QThread::yieldCurrentThread();
+    readerIndex.store(1 - index);
+    while (readers[index].load() != 0)
+        QThread::yieldCurrentThread();
+
+    delete old;
+}
+
+void SettingsManager::publishFromSettings()
+{
+    QSettings config(configPath, QSettings::IniFormat);
+    if(config.status() == QSettings::AccessError){
         qInfo()<<"[SettingsManager] Error Accessing File";
-    } else if(!QFile(config->fileName()).exists()) {
-        qInfo()<<"[SettingsManager] Error Accessing path";
-    } else {
-        qInfo()<<"[SettingsManager] Reading Config File Done";
     }
 
+    SettingsSnapshot* next = new SettingsSnapshot;
+    foreach (const QString& key, config.allKeys())
+        next->values.insert(key, config.value(key));
+    publish(next);
+}
 
-    config->beginGroup(section);
-    QVariant returnValue = config->value(key);
+void SettingsManager::resolveSlots(SettingsSnapshot *next) const
+{
+    next->typedValues.resize(slotInfos.size());
+    for (size_t i = 0; i < slotInfos.size(); ++i) {
+        const SlotInfo& info = slotInfos[i];
+        next->typedValues[i] = info.convert(next->values.value(info.path), info.defaultValue);
+    }
+}
 
-    if(!config->contains(key))
-        qInfo()<<"[SettingsManager] Key not found ["<<key<<"]";
+int SettingsManager::registerSlot(const QString &path, const QVariant &defaultValue, SlotConverter convert)
+{
+    QMutexLocker lock(&writeMutex);
 
-    config->endGroup();
+    //Handles of the same setting share a slot
+    for (size_t i = 0; i < slotInfos.size(); ++i) {
+        const SlotInfo& info = slotInfos[i];
+        if (info.path == path && info.convert == convert && info.defaultValue == defaultValue)
+            return static_cast<int>(i);
+    }
 
-    m.unlock();
-    return returnValue;
+    SlotInfo info = { path, defaultValue, convert };
+    slotInfos.push_back(info);
+
+    //Readers only see the new slot once a snapshot containing it is out
+    publish(new SettingsSnapshot(*snapshot.load()));
+    return static_cast<int>(slotInfos.size() - 1);
+}
+
+void SettingsManager::writeValue(const QString &path, const QVariant &val)
+{
+    SettingsSnapshot* next = new SettingsSnapshot(*snapshot.load());
+    next->values.insert(path, val);
+    publish(next);
+    ++generation;
+}
+
+void SettingsManager::watchConfigFile()
+{
+    const QString dir = QFileInfo(configPath).absolutePath();
+    if (!watcher->directories().contains(dir))
+        watcher->addPath(dir);
+    if (QFile::exists(configPath) && !watcher->files().contains(configPath))
+        watcher->addPath(configPath);
+}
+
+void SettingsManager::configFileChanged()
+{
+    //Runs in the thread owning the watcher
+    watchConfigFile();
+    requestReload();
+}
+
+void SettingsManager::requestReload()
+{
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        reloadRequested = true;
+    }
+    flushCondition.notify_one();
+}
+
+void SettingsManager::reloadFromDisk()
+{
+    QMutexLocker persist_lock(&persistMutex);
+
+    if (!QFile::exists(configPath))
+        return;
+
+    QSettings config(configPath, QSettings::IniFormat);
+    if (config.status() != QSettings::NoError) {
+        qWarning()<<"[SettingsManager] Error Reading"<<configPath;
+        return;
+    }
+
+    QHash<QString, QVariant> onDisk;
+    foreach (const QString& key, config.allKeys())
+        onDisk.insert(key, config.value(key));
+
+    //Keys edited, added or removed since the file was last read or written
+    QHash<QString, QVariant> edits;
+    for (QHash<QString, QVariant>::const_iterator it = onDisk.constBegin(); it != onDisk.constEnd(); ++it) {
+        if (!sameValue(diskValues.value(it.key()), it.value()))
+            edits.insert(it.key(), it.value());
+    }
+    for (QHash<QString, QVariant>::const_iterator it = diskValues.constBegin(); it != diskValues.constEnd(); ++it) {
+        if (!onDisk.contains(it.key()))
+            edits.insert(it.key(), QVariant());
+    }
+    diskValues = onDisk;
+
+    if (edits.isEmpty())
+        return;
+
+    QList<QString> changed;
+    {
+        QMutexLocker lock(&writeMutex);
+        SettingsSnapshot* next = new SettingsSnapshot(*snapshot.load());
+        for (QHash<QString, QVariant>::const_iterator it = edits.constBegin(); it != edits.constEnd(); ++it) {
+            if (sameValue(next->values.value(it.key()), it.value()))
+                continue;
+            if (it.value().isValid())
+                next->values.insert(it.key(), it.value());
+            else
+                next->values.remove(it.key());
+            changed.append(it.key());
+        }
+        publish(next);
+    }
+
+    foreach (const QString& path, changed) {
+        QString section, key;
+        splitPath(path, section, key);
+        emit valueChanged(section, key, edits.value(path));
+    }
+}
+
+void SettingsManager::markDirty(int changes)
+{
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        if (dirtyCount == 0)
+            firstDirty = std::chrono::steady_clock::now();
+        dirtyCount += changes;
+    }
+    flushCondition.notify_one();
+}
+
+void SettingsManager::flusherLoop()
+{
+    std::unique_lock<std::mutex> lock(flushMutex);
+    for (;;) {
+        flushCondition.wait(lock, [this] { return stopFlusher || reloadRequested || dirtyCount > 0; });
+        if (stopFlusher)
+            return;
+
+        if (reloadRequested) {
+            reloadRequested = false;
+            lock.unlock();
+            reloadFromDisk();
+            lock.lock();
+            continue;
+        }
+
+        //Let changes pile up until the interval is over or enough are pending
+        const std::chrono::steady_clock::time_point deadline =
+                firstDirty + std::chrono::milliseconds(flushIntervalMs);
+        flushCondition.wait_until(lock, deadline, [this] {
+            return stopFlusher || reloadRequested || dirtyCount >= flushMaxDirty;
+        });
+        if (stopFlusher)
+            return;
+        if (reloadRequested)
+            continue;
+        dirtyCount = 0;
+
+        lock.unlock();
+        const bool ok = persist();
+        lock.lock();
+
+        //Retry with the next interval
+        if (!ok && dirtyCount == 0) {
+            firstDirty = std::chrono::steady_clock::now();
+            dirtyCount = 1;
+        }
+    }
+}
+
+bool SettingsManager::persist()
+{
+    QMutexLocker persist_lock(&persistMutex);
+
+    QHash<QString, QVariant> values;
+    quint64 target;
+    {
+        //QHash copies are implicitly shared, this is cheap
+        QMutexLocker lock(&writeMutex);
+        values = snapshot.load()->values;
+        target = generation;
+    }
+    if (target == persistedGeneration)
+        return true;
+
+    //Write a complete file next to config.ini and rename it over the old
+    //one, so readers of the file never see a partial write
+    const QString tempPath = configPath + ".tmp";
+    {
+        QSettings temp(tempPath, QSettings::IniFormat);
+        temp.clear();
+        for (QHash<QString, QVariant>::const_iterator it = values.constBegin(); it != values.constEnd(); ++it)
+            temp.setValue(it.key(), it.value());
+        temp.sync();
+
+        if (temp.status() != QSettings::NoError) {
+            qWarning()<<"[SettingsManager] Error Writing"<<tempPath;
+            return false;
+        }
+    }
+
+    if (!replaceFile(tempPath, configPath)) {
+        qWarning()<<"[SettingsManager] Error Replacing"<<configPath;
+        return false;
+    }
+
+    persistedGeneration = target;
+    diskValues = values;
+    return true;
+}
+
+QVariant SettingsManager::getValue(QString key)
+{
+    return instance()->readValue(key);
+}
+
+QVariant SettingsManager::getValue(QString section, QString key)
+{
+    if (section.isEmpty())
+        return instance()->readValue(key);
+    return instance()->readValue(section + QLatin1Char('/') + key);
 }
 
 void SettingsManager::setValue(QString key, QVariant val)
 {
-    QSettings* config = instance()->sets;
-    return config->setValue(key, val);
+    SettingsManager* mgr = instance();
+    {
+        QMutexLocker lock(&mgr->writeMutex);
+        if (sameValue(mgr->snapshot.load()->values.value(key), val))
+            return;
+        mgr->writeValue(key, val);
+    }
+    mgr->markDirty(1);
+
+    QString section, name;
+    splitPath(key, section, name);
+    emit mgr->valueChanged(section, name, val);
 }
 
 void SettingsManager::setValue(QString section, QString key, QVariant val)
 {
-    QSettings* config = instance()->sets;
-    config->beginGroup(section);
-    config->setValue(key, val);
-    config->endGroup();
-    config->sync();
+    setValue(section.isEmpty() ? key : section + QLatin1Char('/') + key, val);
+}
+
+bool SettingsManager::flush()
+{
+    return instance()->persist();
+}
+
+void SettingsManager::reload()
+{
+    //The watcher belongs to the manager's thread, leave it alone here
+    instance()->requestReload();
+}
+
+void SettingsManager::setFlushPolicy(int intervalMs, int maxDirty)
+{
+    SettingsManager* mgr = instance();
+    {
+        std::lock_guard<std::mutex> lock(mgr->flushMutex);
+        mgr->flushIntervalMs = qMax(0, intervalMs);
+        mgr->flushMaxDirty = qMax(1, maxDirty);
+    }
+    mgr->flushCondition.notify_one();
 }
 
 SettingsManager::~SettingsManager()
 {
-    sets->deleteLater();
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        stopFlusher = true;
+    }
+    flushCondition.notify_one();
+    flusher.join();
+
+    persist();
+    delete snapshot.load();
 }
 
 
 void SettingsManager::setdefaultSettings()
 {
-    QSettings* config = instance()->sets;
-    config->beginGroup("logging");
-    config->setValue("fileName", "../logs/PILlog.log");
-    config->setValue("minLevel", 0);
-    config->setValue("bufferSize", 100);
-    config->setValue("maxSize", 1000000);
-    config->setValue("maxBackups", 2);
-    config->setValue("timestampFormat", "dd.MM.yyyy hh:mm:ss.zzz");
-    config->setValue("msgFormat", "{timestamp} {typeNr} {type} {msg}\n  in line {line} function {function}");
-    config->endGroup();
-
-    config->sync();
+    QList<QPair<QString, QVariant> > defaults;
+    defaults.append(qMakePair(QString("logging/fileName"), QVariant("../logs/PILlog.log")));
+    defaults.append(qMakePair(QString("logging/minLevel"), QVariant(0)));
+    defaults.append(qMakePair(QString("logging/bufferSize"), QVariant(100)));
+    defaults.append(qMakePair(QString("logging/maxSize"), QVariant(1000000)));
+    defaults.append(qMakePair(QString("logging/maxBackups"), QVariant(2)));
+    defaults.append(qMakePair(QString("logging/timestampFormat"), QVariant("dd.MM.yyyy hh:mm:ss.zzz")));
+    defaults.append(qMakePair(QString("logging/msgFormat"), QVariant("{timestamp} {typeNr} {type} {msg}\n  in line {line} function {function}")));
+
+    //All changed defaults go out as one snapshot and one dirty batch
+    QList<QPair<QString, QVariant> > changed;
+    {
+        QMutexLocker lock(&writeMutex);
+        SettingsSnapshot* config = new SettingsSnapshot(*snapshot.load());
+        for (int i = 0; i < defaults.size(); ++i) {
+            if (sameValue(config->values.value(defaults[i].first), defaults[i].second))
+                continue;
+            config->values.insert(defaults[i].first, defaults[i].second);
+            changed.append(defaults[i]);
+        }
+        if (changed.isEmpty()) {
+            delete config;
+            return;
+        }
+        publish(config);
+        generation += changed.size();
+    }
+
+    markDirty(changed.size());
+
+    for (int i = 0; i < changed.size(); ++i) {
+        QString section, key;
+        splitPath(changed[i].first, section, key);
+        emit valueChanged(section, key, changed[i].second);
+    }
 }
 
 }//end of namespace pil
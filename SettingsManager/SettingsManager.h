@@ -6,6 +6,16 @@
 #include <QSettings>
 #include <QDebug>
 #include <QMutex>
+#include <QHash>
+#include <QFileSystemWatcher>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #ifndef DllCoreExport
 #ifdef DLL_CORE_EXPORT
@@ -18,13 +28,140 @@
 
 namespace pil {
 
+/**
+ * @brief The SettingSlot struct Value of a registered Setting, converted to
+ *        its type when the snapshot was built.
+ */
+struct SettingSlot
+{
+    virtual ~SettingSlot() {}
+};
+
+template<class T>
+struct TypedSettingSlot : public SettingSlot
+{
+    explicit TypedSettingSlot(const T& value) : value(value) {}
+    const T value;
+};
+
+/**
+ * @brief The SettingsSnapshot struct Immutable copy of all settings.
+ *        Keys are full paths, i.e. "section/key". typedValues holds the values of
+ *        the registered Setting handles, indexed by their slot.
+ */
+struct SettingsSnapshot
+{
+    QHash<QString, QVariant> values;
+    std::vector<std::shared_ptr<const SettingSlot> > typedValues;
+};
+
+template<class T> class Setting;
+
+
 class DllCoreExport SettingsManager : public QObject
 {
     Q_OBJECT
+    template<class T> friend class Setting;
+
 private:
     explicit SettingsManager(QObject *parent = 0);
-    static SettingsManager* _instance;
-    QSettings*   sets;
+    QString      configPath;
+
+    /**
+     * Readers never lock. They announce themselves on one of two
+     * reader counters, load the current snapshot and leave again.
+     * A writer publishes the new snapshot, flips the counter readers
+     * use and waits for both counters to drain before freeing the old
+     * snapshot, so a snapshot is never freed under a reader.
+     */
+    std::atomic<const SettingsSnapshot*> snapshot;
+    mutable std::atomic<int> readers[2];
+    std::atomic<int> readerIndex;
+
+    //Serializes writers
+    QMutex writeMutex;
+
+    /**
+     * Writes only change the snapshot and count as dirty. A background
+     * flusher persists the snapshot once flushIntervalMs passed since the
+     * first unsaved change or flushMaxDirty changes piled up, whichever
+     * comes first. The same thread reloads config.ini after it was
+     * changed on disk.
+     */
+    std::mutex flushMutex;
+    std::condition_variable flushCondition;
+    std::chrono::steady_clock::time_point firstDirty;
+    int dirtyCount;
+    int flushIntervalMs;
+    int flushMaxDirty;
+    bool reloadRequested;
+    bool stopFlusher;
+    std::thread flusher;
+
+    //Serializes reads and writes of config.ini
+    QMutex persistMutex;
+
+    //Number of changes applied to the snapshot and the number on disk
+    quint64 generation;
+    quint64 persistedGeneration;
+
+    /**
+     * The values as they are in config.ini, last read or written.
+     * A reload only applies the keys that differ from these, so edits
+     * on disk win without dropping unsaved changes to other keys.
+     */
+    QHash<QString, QVariant> diskValues;
+
+    QFileSystemWatcher* watcher;
+
+    /**
+     * Registered Setting handles. Every published snapshot converts the
+     * value of each slot once, so handles read without lookup or conversion.
+     * Guarded by writeMutex.
+     */
+    typedef std::shared_ptr<const SettingSlot> (*SlotConverter)(const QVariant& value, const QVariant& defaultValue);
+    struct SlotInfo {
+        QString path;
+        QVariant defaultValue;
+        SlotConverter convert;
+    };
+    std::vector<SlotInfo> slotInfos;
+
+    int registerSlot(const QString& path, const QVariant& defaultValue, SlotConverter convert);
+    void resolveSlots(SettingsSnapshot* next) const;
+
+    template<class T>
+    static std::shared_ptr<const SettingSlot> convertSlot(const QVariant& value, const QVariant& defaultValue)
+    {
+        QVariant converted = value;
+        if (!value.isValid() || !converted.convert(qMetaTypeId<T>()))
+            converted = defaultValue;
+        return std::make_shared<TypedSettingSlot<T> >(converted.value<T>());
+    }
+
+    template<class T>
+    T readSlot(int slot) const
+    {
+        const int index = readerIndex.load();
+        readers[index].fetch_add(1);
+
+        const SettingsSnapshot* current = snapshot.load();
+        T returnValue = static_cast<const TypedSettingSlot<T>*>(current->typedValues[slot].get())->value;
+
+        readers[index].fetch_sub(1);
+        return returnValue;
+    }
+
+    QVariant readValue(const QString& path) const;
+    void publish(SettingsSnapshot* next);
+    void publishFromSettings();
+    void writeValue(const QString& path, const QVariant& val);
+    void markDirty(int changes);
+    void flusherLoop();
+    bool persist();
+    void reloadFromDisk();
+    void requestReload();
+    void watchConfigFile();
 
 public:
     static SettingsManager*   instance();
@@ -33,13 +170,88 @@ public:
     static void               setValue(QString key, QVariant val);
     static void               setValue(QString section, QString key ,QVariant val);
 
+    /**
+     * @brief flush Writes pending changes to config.ini and returns once
+     *        they are on disk. Returns false if the file could not be written.
+     */
+    static bool               flush();
+
+    /**
+     * @brief setFlushPolicy Sets when the background flusher persists
+     *        changes: intervalMs after the first unsaved change, or as soon
+     *        as maxDirty changes are pending. Defaults are 1000 ms and 64.
+     */
+    static void               setFlushPolicy(int intervalMs, int maxDirty);
+
+    /**
+     * @brief reload Rereads config.ini on the background thread. Happens
+     *        automatically when the file changes while an event loop runs
+     *        in the thread that created the manager.
+     */
+    static void               reload();
+
     void setdefaultSettings();
 
     ~SettingsManager();
 
 signals:
+    /**
+     * @brief valueChanged Emitted once per key whose value changed, either
+     *        through setValue or through an edit of config.ini. Removed keys
+     *        report an invalid value. Changes from the file are emitted from
+     *        the background thread, connect with a queued connection (the
+     *        default across threads) to handle them in the receiver's thread.
+     * @param section The section of the key, empty for keys outside sections
+     */
+    void valueChanged(const QString& section, const QString& key, const QVariant& value);
 
 public slots:
+
+private slots:
+    void configFileChanged();
+};
+
+
+/**
+ * @brief The Setting class Typed handle to one setting, for reads in hot
+ *        paths. The key is resolved once on construction; get() then copies
+ *        the already converted value out of the current snapshot without
+ *        hashing, locking or allocating (beyond what copying T needs).
+ *        Values missing from the settings or not convertible to T read as
+ *        defaultValue. Handles are cheap to copy and safe to read from any
+ *        thread.
+ *
+ *        static const pil::Setting<int> minLevel("logging", "minLevel", 0);
+ *        if (level >= minLevel.get()) ...
+ */
+template<class T>
+class Setting
+{
+public:
+    Setting(const QString& section, const QString& key, const T& defaultValue) :
+        manager(SettingsManager::instance()),
+        path(section.isEmpty() ? key : section + QLatin1Char('/') + key),
+        slotIndex(manager->registerSlot(path, QVariant::fromValue(defaultValue),
+                                        &SettingsManager::convertSlot<T>))
+    {
+    }
+
+    T get() const {
+        return manager->readSlot<T>(slotIndex);
+    }
+
+    void set(const T& value) const {
+        SettingsManager::setValue(path, QVariant::fromValue(value));
+    }
+
+    const QString& key() const {
+        return path;
+    }
+
+private:
+    SettingsManager* manager;
+    QString path;
+    int slotIndex;
 };
 
 
@@ -16,8 +16,10 @@ MOC_DIR = .tmplib
 
 SOURCES += \
     SettingsManager.cpp\
+    Logger.cpp\
     main.cpp	
 
 HEADERS += \
-    SettingsManager.h
+    SettingsManager.h\
+    Logger.h
 
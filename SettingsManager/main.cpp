@@ -1,5 +1,6 @@
 #include <QCoreApplication>
 #include "SettingsManager.h"
+#include "Logger.h"
 #include <QDebug>
 #include <QTime>
 
@@ -31,6 +32,10 @@ int main(int argc, char** argv)
 
     pil::SettingsManager* mgr = pil::SettingsManager::instance();
     mgr->setdefaultSettings();
+
+    //Configured from the logging section, so created after the defaults
+    pil::Logger::installMessageHandler();
+    PIL_LOG_INFO("Settings loaded");
     mgr->setValue("Anubhav","Hello","123");
     mgr->setValue("Anubhav","Check","1222");
     mgr->setValue("Anubhav","Ben","123");
@@ -42,6 +47,10 @@ int main(int argc, char** argv)
 
     qDebug()<<pil::SettingsManager::getValue("Anubhav","Ben").toString();
 
+    //Typed handle, resolved once and read without string lookups
+    const pil::Setting<int> ben("Anubhav", "Ben", 0);
+    qDebug()<<ben.get();
+
 
 //    app.exec();
     return 0;